@@ -0,0 +1,136 @@
+#include "compressed_postings.h"
+#include "galloping_search.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+uint32_t GetBitWidth(uint32_t max_value) {
+    uint32_t bits = 0;
+    while (bits < 32 && (max_value >> bits) != 0) {
+        ++bits;
+    }
+    return bits;
+}
+
+//значение i занимает биты [i * bits, (i + 1) * bits) потока слов
+void PackBits(const uint32_t* values, size_t count, uint32_t bits, vector<uint32_t>& output) {
+    const size_t begin = output.size();
+    output.resize(begin + (count * bits + 31) / 32, 0);
+    for (size_t i = 0; bits > 0 && i < count; ++i) {
+        const size_t position = i * bits;
+        const uint64_t value = uint64_t{values[i]} << (position % 32);
+        output[begin + position / 32] |= static_cast<uint32_t>(value);
+        if (position % 32 + bits > 32) {
+            output[begin + position / 32 + 1] |= static_cast<uint32_t>(value >> 32);
+        }
+    }
+}
+
+//при постоянной ширине сдвиги и маска известны при компиляции, цикл разворачивается и векторизуется;
+//значения проходят через transform: так номера документов восстанавливаются из разностей в том же цикле
+template <uint32_t Bits, typename Value, typename Transform>
+void UnpackBits(const uint32_t* input, size_t count, Value* values, Transform transform) {
+    //блок из одинаковых значений не занимает ни одного слова: input может указывать на слово
+    //выравнивания в конце данных, читать по нему 8 байт нельзя
+    if constexpr (Bits == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = transform(0);
+        }
+        return;
+    }
+    constexpr uint64_t mask = (uint64_t{1} << Bits) - 1;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t position = i * Bits;
+        uint64_t word;
+        memcpy(&word, input + position / 32, sizeof(word));
+        values[i] = transform(static_cast<uint32_t>((word >> (position % 32)) & mask));
+    }
+}
+
+template <typename Value, typename Transform, uint32_t... Bits>
+void UnpackBits(const uint32_t* input, size_t count, uint32_t bits, Value* values, Transform transform,
+                integer_sequence<uint32_t, Bits...>) {
+    using Unpack = void (*)(const uint32_t*, size_t, Value*, Transform);
+    static const Unpack unpacks[] = {UnpackBits<Bits, Value, Transform>...};
+    unpacks[bits](input, count, values, transform);
+}
+
+template <typename Value, typename Transform>
+void UnpackBits(const uint32_t* input, size_t count, uint32_t bits, Value* values, Transform transform) {
+    UnpackBits(input, count, bits, values, transform, make_integer_sequence<uint32_t, 33>());
+}
+
+} // namespace
+
+void CompressedPostings::AppendBlock(const int* ordinals, const uint32_t* counts, size_t count) {
+    const int base = headers_.empty() ? -1 : headers_.back().last_ordinal;
+    uint32_t deltas[block_size_];
+    uint32_t counts_minus_one[block_size_];
+    uint32_t max_delta = 0;
+    uint32_t max_count = 0;
+    for (size_t i = 0; i < count; ++i) {
+        deltas[i] = static_cast<uint32_t>(ordinals[i] - (i > 0 ? ordinals[i - 1] : base) - 1);
+        counts_minus_one[i] = counts[i] - 1;
+        max_delta = max(max_delta, deltas[i]);
+        max_count = max(max_count, counts_minus_one[i]);
+    }
+
+    if (!data_.empty()) {
+        data_.pop_back();
+    }
+    BlockHeader header;
+    header.last_ordinal = ordinals[count - 1];
+    header.offset = static_cast<uint32_t>(data_.size());
+    header.size = static_cast<uint8_t>(count);
+    header.ordinal_bits = static_cast<uint8_t>(GetBitWidth(max_delta));
+    header.count_bits = static_cast<uint8_t>(GetBitWidth(max_count));
+    PackBits(deltas, count, header.ordinal_bits, data_);
+    PackBits(counts_minus_one, count, header.count_bits, data_);
+    data_.push_back(0);
+    headers_.push_back(header);
+}
+
+size_t CompressedPostings::GetBlockCount() const {
+    return headers_.size();
+}
+
+size_t CompressedPostings::GetBlockSize(size_t block) const {
+    return headers_[block].size;
+}
+
+int CompressedPostings::GetLastOrdinal(size_t block) const {
+    return headers_[block].last_ordinal;
+}
+
+//курсоры ищут номер недалеко от текущего блока, поэтому заголовки просматриваются галопом от block
+size_t CompressedPostings::FindBlock(size_t block, int ordinal) const {
+    return GallopingLowerBound(headers_.begin() + block, headers_.end(), ordinal, [](const BlockHeader& header, int value) {
+        return header.last_ordinal < value;
+    }) - headers_.begin();
+}
+
+void CompressedPostings::DecodeOrdinals(size_t block, int* ordinals) const {
+    const BlockHeader& header = headers_[block];
+    int ordinal = block > 0 ? headers_[block - 1].last_ordinal : -1;
+    UnpackBits(data_.data() + header.offset, header.size, header.ordinal_bits, ordinals, [&ordinal](uint32_t delta) {
+        ordinal += static_cast<int>(delta) + 1;
+        return ordinal;
+    });
+}
+
+void CompressedPostings::DecodeCounts(size_t block, uint32_t* counts) const {
+    const BlockHeader& header = headers_[block];
+    const uint32_t* input = data_.data() + header.offset + (header.size * header.ordinal_bits + 31) / 32;
+    UnpackBits(input, header.size, header.count_bits, counts, [](uint32_t count_minus_one) {
+        return count_minus_one + 1;
+    });
+}
+
+size_t CompressedPostings::GetMemoryUsage() const {
+    return headers_.capacity() * sizeof(BlockHeader) + data_.capacity() * sizeof(uint32_t);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Сжатая часть списка документов слова. Список делится на блоки до block_size_ элементов:
+//номера документов хранятся разностями с предыдущим, разности и числа вхождений слова
+//упаковываются минимальным для блока числом бит. Блок распаковывается целиком без ветвлений
+//в цикле, по заголовкам блоков номер документа ищется, не распаковывая лишнего
+class CompressedPostings {
+public:
+    const static std::size_t block_size_ = 128;
+
+    //ordinals возрастают и больше номеров в уже добавленных блоках, counts > 0, count <= block_size_
+    void AppendBlock(const int *ordinals, const std::uint32_t *counts, std::size_t count);
+
+    std::size_t GetBlockCount() const;
+
+    std::size_t GetBlockSize(std::size_t block) const;
+
+    int GetLastOrdinal(std::size_t block) const;
+
+    //первый блок начиная с block, в котором есть номер не меньше ordinal (или GetBlockCount())
+    std::size_t FindBlock(std::size_t block, int ordinal) const;
+
+    //номера документов и числа вхождений распаковываются отдельно: курсору, который ищет номер,
+    //числа вхождений нужны, только если документ нашёлся. Массивы вмещают block_size_ элементов
+    void DecodeOrdinals(std::size_t block, int *ordinals) const;
+    void DecodeCounts(std::size_t block, std::uint32_t *counts) const;
+
+    std::size_t GetMemoryUsage() const;
+
+private:
+    struct BlockHeader {
+        int last_ordinal;
+        std::uint32_t offset;//начало блока в data_
+        std::uint8_t size;
+        std::uint8_t ordinal_bits;
+        std::uint8_t count_bits;
+    };
+
+    std::vector<BlockHeader> headers_;
+    //упакованные значения; в конце одно пустое слово, чтобы распаковка могла читать по 8 байт
+    std::vector<std::uint32_t> data_;
+};
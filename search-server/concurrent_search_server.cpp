@@ -0,0 +1,261 @@
+#include "concurrent_search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+using namespace std;
+
+vector<Document> IndexSnapshot::FindTopDocuments(const string_view raw_query, DocumentStatus status, size_t top_k) const {
+    return FindTopDocuments(execution::seq, raw_query, status, top_k);
+}
+
+vector<Document> IndexSnapshot::FindTopDocuments(const string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> IndexSnapshot::MatchDocument(const string_view raw_query, int document_id) const {
+    for (const Segment& segment : segments_) {
+        if (segment.index->document_to_ordinal_.count(document_id) > 0 && IsLive(segment, document_id)) {
+            return segment.index->MatchDocument(raw_query, document_id);
+        }
+    }
+    throw out_of_range("Document id is not valid"s);
+}
+
+int IndexSnapshot::GetDocumentCount() const {
+    return document_count_;
+}
+
+size_t IndexSnapshot::GetSegmentCount() const {
+    return segments_.size();
+}
+
+CollectionStats IndexSnapshot::GetCollectionStats() const {
+    return {document_count_, document_count_ > 0 ? total_document_length_ * 1.0 / document_count_ : 0.0};
+}
+
+bool IndexSnapshot::IsLive(const Segment& segment, int document_id) {
+    return segment.removed_ids->empty() || segment.removed_ids->count(document_id) == 0;
+}
+
+IndexSnapshot::Segment IndexSnapshot::MakeSegment(shared_ptr<const SearchServer> index) {
+    return {move(index), make_shared<const set<int>>(), make_shared<const unordered_map<SearchServer::TermId, int>>(), 0};
+}
+
+IndexSnapshot::Segment IndexSnapshot::RemoveDocuments(const Segment& segment, const set<int>& document_ids) {
+    const SearchServer& index = *segment.index;
+    auto removed_ids = make_shared<set<int>>(*segment.removed_ids);
+    auto removed_term_counts = make_shared<unordered_map<SearchServer::TermId, int>>(*segment.removed_term_counts);
+    uint64_t removed_length = segment.removed_length;
+    for (const int document_id : document_ids) {
+        if (!removed_ids->insert(document_id).second) {
+            continue;
+        }
+        const int ordinal = index.document_to_ordinal_.at(document_id);
+        for (const auto [term, _] : index.GetTermCounts(index.documents_[ordinal])) {
+            ++(*removed_term_counts)[term];
+        }
+        removed_length += index.document_lengths_[ordinal];
+    }
+    return {segment.index, move(removed_ids), move(removed_term_counts), removed_length};
+}
+
+int IndexSnapshot::CountLiveDocuments(const Segment& segment, SearchServer::TermId term) {
+    const int count = segment.index->word_to_document_freqs_[term].live_count;
+    const auto it = segment.removed_term_counts->find(term);
+    return it == segment.removed_term_counts->end() ? count : count - it->second;
+}
+
+ConcurrentSearchServer::~ConcurrentSearchServer() {
+    {
+        lock_guard guard(write_mutex_);
+        stop_ = true;
+    }
+    merge_state_changed_.notify_all();
+    merger_.join();
+}
+
+void ConcurrentSearchServer::Start() {
+    memtable_ = make_unique<SearchServer>(empty_index_);
+    PublishSegments();
+    merger_ = thread([this] {
+        MergeSegments();
+    });
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
+                                         const vector<int>& ratings) {
+    lock_guard guard(write_mutex_);
+    //id должен быть уникален во всех сегментах, а не только в изменяемом
+    if (document_ids_.count(document_id) > 0) {
+        throw invalid_argument("Ошибка добавления документа"s);
+    }
+    memtable_->AddDocument(document_id, document, status, ratings);
+    document_ids_.insert(document_id);
+}
+
+void ConcurrentSearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    lock_guard guard(write_mutex_);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (document_ids_.count(documents[i].id) > 0) {
+            //ошибку в документах до повторного id сообщаем раньше, как SearchServer::AddDocuments
+            SearchServer(empty_index_).AddDocuments(vector<NewDocument>(documents.begin(), documents.begin() + i));
+            throw invalid_argument("Ошибка добавления документа "s + to_string(documents[i].id));
+        }
+    }
+    memtable_->AddDocuments(execution::par, documents);
+    for (const NewDocument& document : documents) {
+        document_ids_.insert(document.id);
+    }
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    lock_guard guard(write_mutex_);
+    if (document_ids_.count(document_id) == 0) {
+        throw invalid_argument("Document id is not valid"s);
+    }
+    if (memtable_->document_to_ordinal_.count(document_id) > 0) {
+        memtable_->RemoveDocument(document_id);
+    } else {
+        //в старых сегментах могут лежать удалённые документы с тем же id
+        for (const auto& segment : segments_) {
+            if (segment.index->document_to_ordinal_.count(document_id) > 0 && IndexSnapshot::IsLive(segment, document_id)) {
+                pending_removals_[segment.index.get()].insert(document_id);
+                break;
+            }
+        }
+    }
+    document_ids_.erase(document_id);
+}
+
+void ConcurrentSearchServer::SetRanking(const RankingFunction& ranking) {
+    lock_guard guard(write_mutex_);
+    //изменяемый сегмент проверяет параметры и бросает исключение до изменений
+    memtable_->SetRanking(ranking);
+    ranking_ = ranking;
+}
+
+void ConcurrentSearchServer::Publish() {
+    {
+        lock_guard guard(write_mutex_);
+        for (auto& segment : segments_) {
+            const auto removals = pending_removals_.find(segment.index.get());
+            if (removals == pending_removals_.end()) {
+                continue;
+            }
+            segment = IndexSnapshot::RemoveDocuments(segment, removals->second);
+            pending_removals_.erase(removals);
+        }
+        if (memtable_->GetDocumentCount() > 0) {
+            segments_.push_back(IndexSnapshot::MakeSegment(move(memtable_)));
+            memtable_ = make_unique<SearchServer>(empty_index_);
+        }
+        PublishSegments();
+    }
+    merge_state_changed_.notify_all();
+}
+
+void ConcurrentSearchServer::WaitForMerges() {
+    unique_lock lock(write_mutex_);
+    merge_state_changed_.wait(lock, [this] {
+        return !is_merging_ && SelectSegmentsToMerge().empty();
+    });
+}
+
+shared_ptr<const IndexSnapshot> ConcurrentSearchServer::GetSnapshot() const {
+    return atomic_load(&published_);
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return GetSnapshot()->GetDocumentCount();
+}
+
+//вызывается под write_mutex_
+void ConcurrentSearchServer::PublishSegments() {
+    auto snapshot = make_shared<IndexSnapshot>();
+    snapshot->segments_ = segments_;
+    if (snapshot->segments_.empty()) {
+        //пустой сегмент нужен, чтобы проверять запросы к пустому серверу
+        snapshot->segments_.push_back(IndexSnapshot::MakeSegment(make_shared<const SearchServer>(empty_index_)));
+    }
+    for (const auto& segment : snapshot->segments_) {
+        snapshot->document_count_ += segment.index->GetDocumentCount() - static_cast<int>(segment.removed_ids->size());
+        snapshot->total_document_length_ += segment.index->total_document_length_ - segment.removed_length;
+    }
+    snapshot->ranking_ = ranking_;
+    atomic_store(&published_, shared_ptr<const IndexSnapshot>(move(snapshot)));
+}
+
+//вызывается под write_mutex_. Сливаем merge_factor_ сегментов одного порядка размера
+//(по основанию merge_factor_), поэтому каждый документ переписывается O(log n) раз;
+//сегмент, в котором удалена больше половины документов, переписываем отдельно
+vector<IndexSnapshot::Segment> ConcurrentSearchServer::SelectSegmentsToMerge() const {
+    map<int, vector<IndexSnapshot::Segment>> tiers;
+    for (const auto& segment : segments_) {
+        const int document_count = segment.index->GetDocumentCount();
+        const int removed_count = static_cast<int>(segment.removed_ids->size());
+        if (removed_count * 2 > document_count) {
+            return {segment};
+        }
+        int tier = 0;
+        for (int size = document_count - removed_count; size >= static_cast<int>(merge_factor_); size /= merge_factor_) {
+            ++tier;
+        }
+        tiers[tier].push_back(segment);
+    }
+    for (auto& [tier, tier_segments] : tiers) {
+        if (tier_segments.size() >= merge_factor_) {
+            tier_segments.resize(merge_factor_);
+            return tier_segments;
+        }
+    }
+    return {};
+}
+
+void ConcurrentSearchServer::MergeSegments() {
+    unique_lock lock(write_mutex_);
+    while (true) {
+        merge_state_changed_.wait(lock, [this] {
+            return stop_ || !SelectSegmentsToMerge().empty();
+        });
+        if (stop_) {
+            return;
+        }
+        const vector<IndexSnapshot::Segment> sources = SelectSegmentsToMerge();
+        is_merging_ = true;
+
+        //сливаем без блокировки: исходные сегменты неизменяемы, запись идёт в другие
+        lock.unlock();
+        auto merged = make_shared<SearchServer>(empty_index_);
+        for (const auto& source : sources) {
+            merged->AppendDocuments(*source.index, *source.removed_ids);
+        }
+        lock.lock();
+
+        //удаления, сделанные во время слияния, переносим на новый сегмент
+        set<int> removed_ids;
+        set<int>& pending = pending_removals_[merged.get()];
+        for (const auto& source : sources) {
+            const auto current = find_if(segments_.begin(), segments_.end(), [&source](const IndexSnapshot::Segment& segment) {
+                return segment.index == source.index;
+            });
+            set_difference(current->removed_ids->begin(), current->removed_ids->end(),
+                           source.removed_ids->begin(), source.removed_ids->end(), inserter(removed_ids, removed_ids.end()));
+            segments_.erase(current);
+
+            const auto removals = pending_removals_.find(source.index.get());
+            if (removals != pending_removals_.end()) {
+                pending.insert(removals->second.begin(), removals->second.end());
+                pending_removals_.erase(removals);
+            }
+        }
+        if (pending.empty()) {
+            pending_removals_.erase(merged.get());
+        }
+        segments_.push_back(IndexSnapshot::RemoveDocuments(IndexSnapshot::MakeSegment(move(merged)), removed_ids));
+        PublishSegments();
+        is_merging_ = false;
+        merge_state_changed_.notify_all();
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "constants.h"
+#include "document.h"
+#include "search_server.h"
+
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+//Неизменяемый снимок составного индекса: сегменты и удалённые из них документы.
+//Удалённый документ остаётся в сегменте, пока сегмент не сольют с другими, и только
+//пропускается при поиске. idf и средняя длина документа считаются по всем сегментам, поэтому
+//релевантность та же, что у одного SearchServer с теми же документами и функцией ранжирования
+class IndexSnapshot {
+public:
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query,
+                                           DocumentPredicate document_predicate,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query, DocumentStatus status,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query) const;
+
+    //слова в результате указывают в сегмент, они действительны, пока жив снимок
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    std::size_t GetSegmentCount() const;
+
+private:
+    friend class ConcurrentSearchServer;
+
+    //removed_term_counts - сколько удалённых документов сегмента содержат слово, removed_length -
+    //их суммарная длина; считаются при публикации удалений, чтобы запросы не перебирали удалённые документы
+    struct Segment {
+        std::shared_ptr<const SearchServer> index;
+        std::shared_ptr<const std::set<int>> removed_ids;
+        std::shared_ptr<const std::unordered_map<SearchServer::TermId, int>> removed_term_counts;
+        std::uint64_t removed_length = 0;
+    };
+
+    std::vector<Segment> segments_;
+    int document_count_ = 0;
+    std::uint64_t total_document_length_ = 0;
+    RankingFunction ranking_;
+
+    CollectionStats GetCollectionStats() const;
+
+    static bool IsLive(const Segment &segment, int document_id);
+
+    //сегмент без удалённых документов
+    static Segment MakeSegment(std::shared_ptr<const SearchServer> index);
+
+    //копия сегмента, в которой удалены ещё и документы document_ids
+    static Segment RemoveDocuments(const Segment &segment, const std::set<int> &document_ids);
+
+    //сколько неудалённых документов сегмента содержат слово
+    static int CountLiveDocuments(const Segment &segment, SearchServer::TermId term);
+};
+
+//Сервер, который принимает документы во время поиска. Запросы идут по опубликованному снимку
+//и не ждут записи. Новые документы копятся в изменяемом сегменте, Publish() замораживает его
+//и вместе с удалениями делает видимым запросам. Фоновый поток сливает сегменты одного порядка
+//размера и при слиянии выбрасывает удалённые документы
+class ConcurrentSearchServer {
+public:
+    template <typename StringContainer>
+    explicit ConcurrentSearchServer(const StringContainer& stop_words)
+        : empty_index_(stop_words) {
+        Start();
+    }
+
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+
+    ~ConcurrentSearchServer();
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                     const std::vector<int> &ratings);
+    void AddDocuments(const std::vector<NewDocument> &documents);
+    void RemoveDocument(int document_id);
+
+    //функция ранжирования для запросов к снимкам, опубликованным после вызова. Параметры
+    //проверяются как в SearchServer::SetRanking
+    void SetRanking(const RankingFunction &ranking);
+
+    //делает накопленные изменения видимыми запросам
+    void Publish();
+
+    //ждёт, пока фоновый поток не сольёт все сегменты, которые пора сливать
+    void WaitForMerges();
+
+    //снимок не меняется, пока его держат
+    std::shared_ptr<const IndexSnapshot> GetSnapshot() const;
+
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(const Args&... args) const {
+        return GetSnapshot()->FindTopDocuments(args...);
+    }
+
+    int GetDocumentCount() const;
+
+private:
+    //столько сегментов одного порядка размера сливаются в один
+    const static std::size_t merge_factor_ = 8;
+
+    const SearchServer empty_index_;//образец для новых сегментов
+    std::shared_ptr<const IndexSnapshot> published_;//читается и меняется через std::atomic_load/atomic_store
+
+    std::mutex write_mutex_;
+    std::unique_ptr<SearchServer> memtable_;
+    std::vector<IndexSnapshot::Segment> segments_;
+    std::map<const SearchServer*, std::set<int>> pending_removals_;//ещё не опубликованные удаления
+    std::set<int> document_ids_;//с учётом неопубликованных изменений
+    RankingFunction ranking_;
+    std::condition_variable merge_state_changed_;
+    bool is_merging_ = false;
+    bool stop_ = false;
+    std::thread merger_;
+
+    void Start();
+
+    void PublishSegments();
+
+    std::vector<IndexSnapshot::Segment> SelectSegmentsToMerge() const;
+
+    void MergeSegments();
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> IndexSnapshot::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate,
+                                                      std::size_t top_k) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k);
+}
+
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> IndexSnapshot::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query,
+                                                      DocumentPredicate document_predicate, std::size_t top_k) const {
+    //запрос разбирается словарём каждого сегмента, число документов со словом суммируется
+    std::vector<SearchServer::Query> queries;
+    std::map<std::string_view, int> word_document_counts;
+    for (const Segment& segment : segments_) {
+        queries.push_back(segment.index->ParseQuery(true, raw_query));
+        for (const SearchServer::TermId term : queries.back().plus_terms) {
+            word_document_counts[segment.index->words_[term]] += CountLiveDocuments(segment, term);
+        }
+    }
+
+    const CollectionStats stats = GetCollectionStats();
+    std::vector<std::vector<Document>> segment_documents(segments_.size());
+    std::visit([&](const auto& ranking) {
+        ParallelFor(policy, segments_.size(), [&](std::size_t i) {
+            const Segment& segment = segments_[i];
+            const SearchServer& index = *segment.index;
+            const auto is_matched = [&segment, &document_predicate](int document_id, DocumentStatus status, int rating) {
+                return IsLive(segment, document_id) && document_predicate(document_id, status, rating);
+            };
+            //все документы со словом могут быть удалены; как и в SearchServer, вес такого слова 0
+            const auto inverse_document_freq = [&ranking, &stats, &index, &word_document_counts](SearchServer::TermId term) {
+                const int word_document_count = word_document_counts.at(index.words_[term]);
+                return word_document_count == 0 ? 0.0 : ranking.ComputeTermWeight(stats, word_document_count);
+            };
+            SearchServer::QueryContext context;
+            index.FindAllDocuments(policy, queries[i], is_matched, ranking, stats, inverse_document_freq, top_k,
+                                   context, segment_documents[i]);
+        });
+    }, ranking_);
+
+    std::vector<Document> matched_documents;
+    for (const auto& documents : segment_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    if (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+        SearchServer::SelectTopDocuments(matched_documents, top_k);
+    } else {
+        SearchServer::SelectTopDocuments(policy, matched_documents, top_k);
+    }
+    return matched_documents;
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> IndexSnapshot::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status,
+                                                      std::size_t top_k) const {
+    return FindTopDocuments(policy, raw_query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, top_k);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> IndexSnapshot::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
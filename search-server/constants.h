@@ -2,3 +2,5 @@
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 constexpr double EPSILON() { return 1e-6; }
+//сколько запросов потоковая обработка держит в памяти одновременно
+const int QUERY_WINDOW_SIZE = 1024;
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct Document {
@@ -21,6 +22,14 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+//документ для пакетного добавления в SearchServer::AddDocuments
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 std::ostream &operator<<(std::ostream &os, const Document &document);
 
 void PrintDocument(const Document &document);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+//Первый элемент [first, last), не меньший value, как std::lower_bound, но поиск идёт от first
+//шагами, растущими вдвое, и только затем уточняется двоичным поиском. Догнать элемент на
+//расстоянии d стоит O(log d), поэтому пересечение отсортированных последовательностей длин
+//m <= n проходом по меньшей стоит O(m log(n / m))
+template <typename RandomIt, typename T, typename Compare>
+RandomIt GallopingLowerBound(RandomIt first, RandomIt last, const T& value, Compare comp) {
+    typename std::iterator_traits<RandomIt>::difference_type step = 1;
+    while (step < last - first && comp(first[step - 1], value)) {
+        first += step;
+        step *= 2;
+    }
+    return std::lower_bound(first, first + std::min(step, last - first), value, comp);
+}
+
+template <typename RandomIt, typename T>
+RandomIt GallopingLowerBound(RandomIt first, RandomIt last, const T& value) {
+    return GallopingLowerBound(first, last, value, std::less<>{});
+}
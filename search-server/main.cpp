@@ -1,9 +1,12 @@
 #include "concurrent_map.h"
+#include "concurrent_search_server.h"
 #include "constants.h"
 #include "document.h"
 #include "log_duration.h"
 #include "paginator.h"
 #include "process_queries.h"
+#include "query_executor.h"
+#include "query_result_cache.h"
 #include "read_input_functions.h"
 #include "remove_duplicates.h"
 #include "request_queue.h"
@@ -11,11 +14,14 @@
 #include "string_processing.h"
 #include "test_example_functions.h"
 
+#include <chrono>
 #include <execution>
 #include <iostream>
+#include <optional>
 #include <random>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -380,7 +386,9 @@ SearchServer search_server("and with"s);
     //RemoveDocument(search_server, 0);//проверка невалидного документа
 
     cout << "Before duplicates removed: "s << search_server.GetDocumentCount() << endl;
-    RemoveDuplicates(search_server);
+    for (const DuplicateDocument& duplicate : RemoveDuplicates(search_server)) {
+        cout << "Found duplicate document id "s << duplicate.document_id << endl;
+    }
     cout << "After duplicates removed: "s << search_server.GetDocumentCount() << endl;
    
     SearchServer search_server1("and in at"s);
@@ -421,6 +429,515 @@ SearchServer search_server("and with"s);
         }
     }
     */
+/*
+    //замер индекса: добавление, поиск и удаление на большом корпусе
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 200'000, 70);
+        const auto queries = GenerateQueries(generator, dictionary, 300, 7);
+
+        SearchServer search_server(dictionary[0]);
+        {
+            LOG_DURATION("AddDocument"s);
+            for (size_t i = 0; i < documents.size(); ++i) {
+                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+        }
+        TEST(seq);
+        TEST(par);
+        {
+            LOG_DURATION("RemoveDocument"s);
+            for (size_t i = 0; i < documents.size(); i += 10) {
+                search_server.RemoveDocument(i);
+            }
+        }
+    }
+*/
+/*
+    //замер повторных запросов без изменений индекса: idf берётся из кэша
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 200'000, 12);
+        const auto documents = GenerateQueries(generator, dictionary, 20'000, 20);
+        const auto queries = GenerateQueries(generator, dictionary, 1'000, 8);
+
+        SearchServer search_server("and"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        LOG_DURATION("Repeated queries"s);
+        double total_relevance = 0;
+        for (int i = 0; i < 200; ++i) {
+            for (const string_view query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+        }
+        cout << total_relevance << endl;
+    }
+*/
+/*
+    //замер холодного старта: построение индекса заново против загрузки сохранённого
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        {
+            LOG_DURATION("Build index"s);
+            SearchServer search_server(dictionary[0]);
+            for (size_t i = 0; i < documents.size(); ++i) {
+                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+            search_server.SaveIndex("index.bin"s);
+        }
+        {
+            LOG_DURATION("Load index"s);
+            const SearchServer search_server = SearchServer::LoadIndex("index.bin"s);
+            cout << search_server.GetDocumentCount() << endl;
+        }
+    }
+*/
+/*
+    //замер запросов во время добавления документов
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 60'000, 70);
+        const auto queries = GenerateQueries(generator, dictionary, 2'000, 7);
+
+        ConcurrentSearchServer search_server(dictionary[0]);
+        for (int i = 0; i < 50'000; ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        search_server.Publish();
+        auto run_queries = [&search_server, &queries] {
+            for (const string_view query : queries) {
+                search_server.FindTopDocuments(query);
+            }
+        };
+        {
+            LOG_DURATION("Queries"s);
+            run_queries();
+        }
+        thread writer([&search_server, &documents] {
+            for (int i = 50'000; i < 60'000; ++i) {
+                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+                if (i % 100 == 0) {
+                    search_server.Publish();
+                }
+            }
+        });
+        {
+            LOG_DURATION("Queries with writer"s);
+            run_queries();
+        }
+        writer.join();
+    }
+*/
+/*
+    //замер непрерывного добавления: задержка запроса по мере роста индекса
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        const auto queries = GenerateQueries(generator, dictionary, 100, 7);
+
+        ConcurrentSearchServer search_server(dictionary[0]);
+        LOG_DURATION("Ingestion"s);
+        for (int i = 0; i < 100'000; ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            if (i % 1'000 == 999) {
+                search_server.Publish();
+            }
+            if (i % 20'000 == 19'999) {
+                cout << i + 1 << " documents, "s << search_server.GetSnapshot()->GetSegmentCount() << " segments"s << endl;
+                LOG_DURATION("100 queries"s);
+                for (const string_view query : queries) {
+                    search_server.FindTopDocuments(query);
+                }
+            }
+        }
+    }
+*/
+/*
+    //замер добавления и удаления вперемешку: индекс всё время держит 50 000 документов
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 150'000, 70);
+        const auto queries = GenerateQueries(generator, dictionary, 300, 7);
+
+        SearchServer search_server(dictionary[0]);
+        vector<int> live_ids;
+        for (int i = 0; i < 50'000; ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            live_ids.push_back(i);
+        }
+        {
+            LOG_DURATION("Churn"s);
+            for (int i = 50'000; i < 150'000; ++i) {
+                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+                live_ids.push_back(i);
+                swap(live_ids[uniform_int_distribution<size_t>(0, live_ids.size() - 1)(generator)], live_ids.back());
+                search_server.RemoveDocument(live_ids.back());
+                live_ids.pop_back();
+            }
+        }
+        TEST(seq);
+    }
+*/
+/*
+    //замер удаления документов с тысячами разных слов: по одному и пакетом
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 200'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 2'000, 3'000);
+        vector<int> removed_ids;
+        for (int i = 0; i < 2'000; i += 2) {
+            removed_ids.push_back(i);
+        }
+        for (const bool is_batch : {false, true}) {
+            SearchServer search_server(dictionary[0]);
+            for (size_t i = 0; i < documents.size(); ++i) {
+                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+            LOG_DURATION(is_batch ? "RemoveDocuments par"s : "RemoveDocument par"s);
+            if (is_batch) {
+                search_server.RemoveDocuments(execution::par, removed_ids);
+            } else {
+                for (const int id : removed_ids) {
+                    search_server.RemoveDocument(execution::par, id);
+                }
+            }
+        }
+    }
+*/
+/*
+    //замер потоковой обработки запросов: запросы генерируются на лету, в памяти только окно
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 2'000, 25);
+        const auto documents = GenerateQueries(generator, dictionary, 20'000, 10);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        LOG_DURATION("ProcessQueriesStream"s);
+        int query_count = 0;
+        size_t document_count = 0;
+        ProcessQueriesStream(search_server, [&]() -> optional<string> {
+            if (query_count == 200'000) {
+                return nullopt;
+            }
+            ++query_count;
+            return GenerateQuery(generator, dictionary, 7);
+        }, [&document_count](size_t, vector<Document>&& documents) {
+            document_count += documents.size();
+        });
+        cout << document_count << endl;
+    }
+*/
+/*
+    //замер пула запросов против std::execution::par: каждый десятый запрос длинный
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 5'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 50'000, 30);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        vector<string> queries;
+        for (int i = 0; i < 20'000; ++i) {
+            queries.push_back(GenerateQuery(generator, dictionary, i % 10 == 0 ? 40 : 3));
+        }
+        const QueryExecutor executor;
+        {
+            LOG_DURATION("ProcessQueries par"s);
+            ProcessQueries(search_server, queries);
+        }
+        {
+            LOG_DURATION("ProcessQueries QueryExecutor"s);
+            ProcessQueries(executor, search_server, queries);
+        }
+    }
+*/
+/*
+    //замер одного широкого запроса: в каждом диапазоне номеров отбираются лучшие документы
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 300, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 200'000, 30);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        const auto queries = GenerateQueries(generator, dictionary, 200, 2);
+        TEST(seq);
+        TEST(par);
+    }
+*/
+/*
+    //замер отбора лучших документов без полного подсчёта релевантности (MaxScore)
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 2'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 200'000, 30);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        for (const int word_count : {2, 4, 8}) {
+            const auto queries = GenerateQueries(generator, dictionary, 300, word_count);
+            cout << word_count << " words"s << endl;
+            TEST(seq);
+            TEST(par);
+        }
+    }
+*/
+/*
+    //пропускная способность разбиения текста на слова с проверкой символов
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 12);
+        const auto documents = GenerateQueries(generator, dictionary, 200'000, 50);
+        size_t byte_count = 0;
+        for (const string& document : documents) {
+            byte_count += document.size();
+        }
+        size_t word_count = 0;
+        const auto start = chrono::steady_clock::now();
+        for (const string& document : documents) {
+            word_count += SplitIntoValidWordsView(document)->size();
+        }
+        const chrono::duration<double> duration = chrono::steady_clock::now() - start;
+        cout << word_count << " words, "s << byte_count / 1e6 / duration.count() << " MB/s"s << endl;
+    }
+*/
+/*
+    //память и скорость поиска до и после сжатия списков документов
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        const auto queries = GenerateQueries(generator, dictionary, 1'000, 7);
+        cout << search_server.GetPostingsMemoryUsage() << " bytes"s << endl;
+        TEST(seq);
+        TEST(par);
+        {
+            LOG_DURATION("CompressPostings"s);
+            search_server.CompressPostings();
+        }
+        cout << search_server.GetPostingsMemoryUsage() << " bytes"s << endl;
+        TEST(seq);
+        TEST(par);
+    }
+*/
+/*
+    //tf-idf через функцию ранжирования работает так же быстро, как прежний встроенный подсчёт;
+    //BM25 дороже только на деление на длину документа
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        const auto queries = GenerateQueries(generator, dictionary, 1'000, 7);
+        cout << "TF-IDF"s << endl;
+        TEST(seq);
+        TEST(par);
+        search_server.SetRanking(Bm25{});
+        cout << "BM25"s << endl;
+        TEST(seq);
+        TEST(par);
+    }
+*/
+/*
+    //поток запросов с распределением Ципфа: запрос номер i встречается пропорционально 1 / (i + 1)
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        const auto distinct_queries = GenerateQueries(generator, dictionary, 10'000, 7);
+        vector<double> weights;
+        for (size_t i = 0; i < distinct_queries.size(); ++i) {
+            weights.push_back(1.0 / (i + 1));
+        }
+        discrete_distribution<size_t> query_distribution(weights.begin(), weights.end());
+        vector<string> queries;
+        for (int i = 0; i < 100'000; ++i) {
+            queries.push_back(distinct_queries[query_distribution(generator)]);
+        }
+
+        TEST(seq);
+        QueryResultCache cache(search_server, 1 << 20);
+        {
+            LOG_DURATION("cached"s);
+            double total_relevance = 0;
+            for (const string& query : queries) {
+                for (const auto& document : cache.FindTopDocuments(query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+            cout << total_relevance << endl;
+        }
+        const QueryCacheStats stats = cache.GetStats();
+        cout << stats.hits << " hits, "s << stats.misses << " misses, "s << stats.evictions << " evictions, "s
+             << stats.memory_usage << " bytes"s << endl;
+    }
+*/
+/*
+    //один контекст на поток: после первых запросов буферы не перевыделяются
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        const auto queries = GenerateQueries(generator, dictionary, 10'000, 7);
+
+        TEST(seq);
+        {
+            LOG_DURATION("context"s);
+            SearchServer::QueryContext context;
+            double total_relevance = 0;
+            for (const string& query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(context, query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+            cout << total_relevance << endl;
+        }
+    }
+*/
+/*
+    //частые минус-слова: "the" есть в 90% документов, "cat" - в 30%
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            if (i % 10 != 0) {
+                documents[i] += " the"s;
+            }
+            if (i % 10 >= 7) {
+                documents[i] += " cat"s;
+            }
+        }
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+        search_server.CompressPostings();
+        auto queries = GenerateQueries(generator, dictionary, 10'000, 7);
+        for (string& query : queries) {
+            query += " -the -cat"s;
+        }
+
+        TEST(seq);
+        TEST(par);
+        {
+            LOG_DURATION("match"s);
+            SearchServer::QueryContext context;
+            size_t matched_count = 0;
+            for (int i = 0; i < 100'000; ++i) {
+                matched_count += get<0>(search_server.MatchDocument(context, queries[i % queries.size()], i)).size();
+            }
+            cout << matched_count << endl;
+        }
+    }
+*/
+/*
+    //прямой индекс: обход слов документов, MatchDocument и удаление
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        const auto queries = GenerateQueries(generator, dictionary, 10'000, 7);
+        SearchServer search_server(dictionary[0]);
+        {
+            LOG_DURATION("add"s);
+            for (size_t i = 0; i < documents.size(); ++i) {
+                search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+        }
+        {
+            LOG_DURATION("word frequencies"s);
+            double total_freq = 0;
+            for (const int document_id : search_server) {
+                for (const auto [word, freq] : search_server.GetWordFrequencies(document_id)) {
+                    total_freq += freq;
+                }
+            }
+            cout << total_freq << endl;
+        }
+        {
+            LOG_DURATION("match"s);
+            size_t matched_count = 0;
+            for (int i = 0; i < 100'000; ++i) {
+                matched_count += get<0>(search_server.MatchDocument(queries[i % queries.size()], i)).size();
+            }
+            cout << matched_count << endl;
+        }
+        {
+            LOG_DURATION("remove"s);
+            for (int i = 0; i < 60'000; ++i) {
+                search_server.RemoveDocument(i);
+            }
+        }
+    }
+*/
+/*
+    //дубликаты: каждый десятый документ повторяет предыдущий, каждый десятый - с одним заменённым словом
+    {
+        mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+        auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+        for (size_t i = 1; i < documents.size(); ++i) {
+            if (i % 10 == 1) {
+                documents[i] = documents[i - 1];
+            } else if (i % 10 == 2) {
+                documents[i] = documents[i - 2] + " "s + dictionary[i % dictionary.size()];
+            }
+        }
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+
+        const DuplicateDetector detector(search_server);
+        {
+            LOG_DURATION("exact seq"s);
+            cout << detector.FindExactDuplicates(execution::seq).size() << endl;
+        }
+        {
+            LOG_DURATION("exact par"s);
+            cout << detector.FindExactDuplicates(execution::par).size() << endl;
+        }
+        {
+            LOG_DURATION("near seq"s);
+            cout << detector.FindNearDuplicates(execution::seq).size() << endl;
+        }
+        {
+            LOG_DURATION("near par"s);
+            cout << detector.FindNearDuplicates(execution::par).size() << endl;
+        }
+    }
+*/
     return 0;
 } 
 
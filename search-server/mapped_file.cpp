@@ -0,0 +1,65 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SEARCH_SERVER_HAS_MMAP
+#endif
+
+using namespace std;
+
+#ifdef SEARCH_SERVER_HAS_MMAP
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("Cannot read file "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Cannot map file "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const string& path) {
+    ifstream input(path, ios::binary);
+    if (!input) {
+        throw runtime_error("Cannot open file "s + path);
+    }
+    buffer_.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile() = default;
+
+#endif
+
+string_view MappedFile::GetData() const {
+    return {data_, size_};
+}
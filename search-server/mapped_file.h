@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+//Файл, открытый только для чтения и отображённый в память. Там, где mmap недоступен,
+//файл целиком читается в буфер
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view GetData() const;
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::string buffer_;
+};
@@ -17,11 +17,27 @@ vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const
 
 vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries) {
     vector<Document> result_joined;
-    for (const auto& documents : ProcessQueries(search_server, queries)) {
-        for (const auto& document : documents) {
-            result_joined.push_back(document);
-        }
-    }
+    ProcessQueriesStream(search_server, queries.begin(), queries.end(), [&result_joined](size_t, vector<Document>&& documents) {
+        result_joined.insert(result_joined.end(), documents.begin(), documents.end());
+    });
 
     return result_joined;
-}
\ No newline at end of file
+}
+
+vector<vector<Document>> ProcessQueries(const QueryExecutor& executor, const SearchServer& search_server, const vector<string>& queries) {
+    vector<vector<Document>> result(queries.size());
+    executor.ParallelFor(queries.size(), [&](size_t i) {
+        result[i] = search_server.FindTopDocuments(queries[i]);
+    });
+
+    return result;
+}
+
+vector<Document> ProcessQueriesJoined(const QueryExecutor& executor, const SearchServer& search_server, const vector<string>& queries) {
+    vector<Document> result_joined;
+    ProcessQueriesStream(executor, search_server, queries.begin(), queries.end(), [&result_joined](size_t, vector<Document>&& documents) {
+        result_joined.insert(result_joined.end(), documents.begin(), documents.end());
+    });
+
+    return result_joined;
+}
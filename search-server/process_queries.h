@@ -1,11 +1,92 @@
 #pragma once
 
+#include "constants.h"
+#include "query_executor.h"
 #include "search_server.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <execution>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <string>
 #include <string_view>
 
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries); 
 
-std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries); 
\ No newline at end of file
+std::vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+//то же на пуле запросов вместо std::execution::par
+std::vector<std::vector<Document>> ProcessQueries(const QueryExecutor& executor, const SearchServer& search_server,
+                                                  const std::vector<std::string>& queries);
+
+std::vector<Document> ProcessQueriesJoined(const QueryExecutor& executor, const SearchServer& search_server,
+                                           const std::vector<std::string>& queries);
+
+//Потоковая обработка: next_query() возвращает очередной запрос (std::optional от string_view
+//или string) или std::nullopt, когда запросы кончились. Запросы выполняются параллельно окнами
+//по window_size, callback(номер запроса, документы) вызывается в порядке запросов. В памяти
+//одновременно не больше window_size запросов и их результатов. policy - std::execution::par или QueryExecutor.
+//Нулевое window_size - invalid_argument
+template <class ExecutionPolicy, typename QuerySource, typename Callback>
+void ProcessQueriesStream(const ExecutionPolicy& policy, const SearchServer& search_server, QuerySource next_query,
+                          Callback callback, std::size_t window_size = QUERY_WINDOW_SIZE) {
+    using Query = typename std::invoke_result_t<QuerySource&>::value_type;
+    //в пустое окно не попадает ни один запрос, и обработка не закончилась бы
+    if (window_size == 0) {
+        throw std::invalid_argument("Query window size must be positive");
+    }
+    std::vector<Query> window;
+    std::vector<std::vector<Document>> results;
+    window.reserve(window_size);
+    std::size_t query_index = 0;
+    bool has_queries = true;
+    while (has_queries) {
+        window.clear();
+        while (window.size() < window_size) {
+            auto query = next_query();
+            if (!query) {
+                has_queries = false;
+                break;
+            }
+            window.push_back(std::move(*query));
+        }
+
+        results.resize(window.size());
+        ParallelFor(policy, window.size(), [&](std::size_t i) {
+            results[i] = search_server.FindTopDocuments(std::string_view(window[i]));
+        });
+        for (auto& documents : results) {
+            callback(query_index++, std::move(documents));
+        }
+    }
+}
+
+template <typename QuerySource, typename Callback>
+void ProcessQueriesStream(const SearchServer& search_server, QuerySource next_query, Callback callback,
+                          std::size_t window_size = QUERY_WINDOW_SIZE) {
+    ProcessQueriesStream(std::execution::par, search_server, next_query, callback, window_size);
+}
+
+//запросы из диапазона [first, last) не копируются: окно держит string_view на них
+template <class ExecutionPolicy, typename QueryIterator, typename Callback>
+void ProcessQueriesStream(const ExecutionPolicy& policy, const SearchServer& search_server, QueryIterator first,
+                          QueryIterator last, Callback callback, std::size_t window_size = QUERY_WINDOW_SIZE) {
+    static_assert(std::is_lvalue_reference_v<decltype(*first)>, "Запросы диапазона должны жить дольше обработки");
+    ProcessQueriesStream(policy, search_server, [&first, last]() -> std::optional<std::string_view> {
+        if (first == last) {
+            return std::nullopt;
+        }
+        return std::string_view(*first++);
+    }, callback, window_size);
+}
+
+template <typename QueryIterator, typename Callback>
+void ProcessQueriesStream(const SearchServer& search_server, QueryIterator first, QueryIterator last, Callback callback,
+                          std::size_t window_size = QUERY_WINDOW_SIZE) {
+    ProcessQueriesStream(std::execution::par, search_server, first, last, callback, window_size);
+}
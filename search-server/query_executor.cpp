@@ -0,0 +1,134 @@
+#include "query_executor.h"
+
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#define SEARCH_SERVER_HAS_AFFINITY
+#endif
+
+using namespace std;
+
+namespace {
+
+//пул и номер потока, в котором выполняется код; у потоков не из пула - nullptr
+thread_local const QueryExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+void PinCurrentThread(int cpu) {
+#ifdef SEARCH_SERVER_HAS_AFFINITY
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    //не удалось закрепить - поток просто работает без закрепления
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
+} // namespace
+
+QueryExecutor::QueryExecutor(size_t worker_count, const vector<int>& cpus) {
+    if (worker_count == 0) {
+        throw invalid_argument("Query executor needs at least one worker"s);
+    }
+    for (const int cpu : cpus) {
+#ifdef SEARCH_SERVER_HAS_AFFINITY
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            throw invalid_argument("Invalid cpu "s + to_string(cpu));
+        }
+#else
+        if (cpu < 0) {
+            throw invalid_argument("Invalid cpu "s + to_string(cpu));
+        }
+#endif
+    }
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_count; ++i) {
+        const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        workers_[i]->thread = thread([this, i, cpu] {
+            WorkerLoop(i, cpu);
+        });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        lock_guard guard(sleep_mutex_);
+        stop_ = true;
+    }
+    has_tasks_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+size_t QueryExecutor::GetWorkerCount() const {
+    return workers_.size();
+}
+
+bool QueryExecutor::IsWorkerThread() const {
+    return current_executor == this;
+}
+
+void QueryExecutor::Push(function<void()> task) const {
+    //из потока пула - в свою очередь, иначе по очереди во все
+    const size_t index = IsWorkerThread() ? current_worker : next_worker_++ % workers_.size();
+    ++queued_task_count_;
+    {
+        lock_guard guard(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(move(task));
+    }
+    {
+        lock_guard guard(sleep_mutex_);
+    }
+    has_tasks_.notify_one();
+}
+
+bool QueryExecutor::TryRunTask() const {
+    function<void()> task;
+    for (size_t i = 0; i < workers_.size() && !task; ++i) {
+        Worker& worker = *workers_[(current_worker + i) % workers_.size()];
+        lock_guard guard(worker.mutex);
+        if (worker.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --queued_task_count_;
+    task();
+    return true;
+}
+
+void QueryExecutor::WorkerLoop(size_t index, int cpu) {
+    current_executor = this;
+    current_worker = index;
+    if (cpu >= 0) {
+        PinCurrentThread(cpu);
+    }
+    while (true) {
+        if (TryRunTask()) {
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        has_tasks_.wait(lock, [this] {
+            return stop_ || queued_task_count_ > 0;
+        });
+        if (stop_ && queued_task_count_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <execution>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Пул потоков для запросов. У каждого потока своя очередь задач: поток берёт задачи с конца
+//своей очереди, а когда она пуста, крадёт с начала чужих. Число потоков задаётся явно, потоки
+//можно закрепить за процессорами (где это поддерживается). Передаётся в методы сервера вместо
+//std::execution::par
+class QueryExecutor {
+public:
+    //потоки закрепляются за процессорами cpus по кругу; пустой cpus - без закрепления
+    explicit QueryExecutor(std::size_t worker_count = std::max(std::thread::hardware_concurrency(), 1u),
+                           const std::vector<int> &cpus = {});
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+    ~QueryExecutor();
+
+    std::size_t GetWorkerCount() const;
+
+    //вызывает function(i) для всех i из [0, count) и ждёт завершения. Поток пула во вложенном
+    //вызове не засыпает, а выполняет задачи; внешний поток спит, чтобы не отнимать процессор у пула.
+    //Первое исключение из function пробрасывается после завершения остальных вызовов
+    template <typename Function>
+    void ParallelFor(std::size_t count, Function function) const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    mutable std::atomic<std::size_t> queued_task_count_{0};
+    mutable std::atomic<std::size_t> next_worker_{0};
+    mutable std::mutex sleep_mutex_;
+    mutable std::condition_variable has_tasks_;
+    bool stop_ = false;
+
+    bool IsWorkerThread() const;
+
+    void Push(std::function<void()> task) const;
+
+    //выполняет одну задачу: сначала из своей очереди, затем украденную из чужой
+    bool TryRunTask() const;
+
+    void WorkerLoop(std::size_t index, int cpu);
+};
+
+template <typename Function>
+void QueryExecutor::ParallelFor(std::size_t count, Function function) const {
+    if (count == 0) {
+        return;
+    }
+    //задач больше, чем потоков, чтобы длинные и короткие запросы распределялись кражей
+    const std::size_t task_size = std::max<std::size_t>(count / (workers_.size() * 16), 1);
+    const std::size_t task_count = (count + task_size - 1) / task_size;
+
+    std::atomic<std::size_t> remaining(task_count);
+    std::mutex done_mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    for (std::size_t begin = 0; begin < count; begin += task_size) {
+        const std::size_t end = std::min(begin + task_size, count);
+        Push([&, begin, end] {
+            try {
+                for (std::size_t i = begin; i < end; ++i) {
+                    function(i);
+                }
+            } catch (...) {
+                std::lock_guard guard(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            //счётчик меняется под done_mutex: ждущий не вернётся, пока последняя задача его держит
+            std::lock_guard guard(done_mutex);
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                done.notify_all();
+            }
+        });
+    }
+    if (IsWorkerThread()) {
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!TryRunTask()) {
+                std::this_thread::yield();
+            }
+        }
+        std::lock_guard guard(done_mutex);
+    } else {
+        std::unique_lock lock(done_mutex);
+        done.wait(lock, [&remaining] {
+            return remaining.load(std::memory_order_acquire) == 0;
+        });
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+//function(i) для i из [0, count): последовательно, стандартной параллельной политикой или на пуле
+template <typename Function>
+void ParallelFor(const std::execution::sequenced_policy&, std::size_t count, Function function) {
+    for (std::size_t i = 0; i < count; ++i) {
+        function(i);
+    }
+}
+
+template <typename Function>
+void ParallelFor(const std::execution::parallel_policy&, std::size_t count, Function function) {
+    std::vector<std::size_t> indexes(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        indexes[i] = i;
+    }
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), function);
+}
+
+template <typename Function>
+void ParallelFor(const QueryExecutor& executor, std::size_t count, Function function) {
+    executor.ParallelFor(count, function);
+}
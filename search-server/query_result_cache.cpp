@@ -0,0 +1,122 @@
+#include "query_result_cache.h"
+
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+void HashCombine(size_t& seed, size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
+
+bool QueryResultCache::Key::operator==(const Key& other) const {
+    return query.plus_terms == other.query.plus_terms && query.minus_terms == other.query.minus_terms
+        && status == other.status && top_k == other.top_k;
+}
+
+size_t QueryResultCache::KeyHash::operator()(const Key& key) const {
+    size_t seed = hash<size_t>{}(key.top_k);
+    HashCombine(seed, static_cast<size_t>(key.status));
+    for (const SearchServer::TermId term : key.query.plus_terms) {
+        HashCombine(seed, term);
+    }
+    //разделитель: плюс-слово и такое же минус-слово дают разные ключи
+    HashCombine(seed, key.query.plus_terms.size());
+    for (const SearchServer::TermId term : key.query.minus_terms) {
+        HashCombine(seed, term);
+    }
+    return seed;
+}
+
+QueryResultCache::QueryResultCache(const SearchServer& search_server, size_t memory_limit, size_t shard_count)
+    : search_server_(search_server)
+    , shard_memory_limit_(memory_limit / max<size_t>(shard_count, 1))
+    , shards_(max<size_t>(shard_count, 1)) {
+}
+
+vector<Document> QueryResultCache::FindTopDocuments(const string_view raw_query, DocumentStatus status, size_t top_k) {
+    return FindTopDocuments(execution::seq, raw_query, status, top_k);
+}
+
+QueryCacheStats QueryResultCache::GetStats() const {
+    QueryCacheStats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    stats.evictions = evictions_.load();
+    for (const Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        stats.entry_count += shard.entries.size();
+        stats.memory_usage += shard.memory_usage;
+    }
+    return stats;
+}
+
+void QueryResultCache::Clear() {
+    for (Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        shard.index.clear();
+        shard.entries.clear();
+        shard.memory_usage = 0;
+    }
+}
+
+QueryResultCache::Key QueryResultCache::MakeKey(const string_view raw_query, DocumentStatus status, size_t top_k) const {
+    return {search_server_.ParseQuery(true, raw_query), status, top_k};
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const Key& key) {
+    //старшие биты: по младшим unordered_map части выбирает корзину
+    return shards_[(KeyHash{}(key) >> (sizeof(size_t) * 4)) % shards_.size()];
+}
+
+optional<vector<Document>> QueryResultCache::Find(const Key& key) {
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        ++misses_;
+        return nullopt;
+    }
+    const auto entry = it->second;
+    if (entry->generation != search_server_.index_generation_) {
+        shard.memory_usage -= entry->memory_usage;
+        shard.index.erase(it);
+        shard.entries.erase(entry);
+        ++misses_;
+        return nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    ++hits_;
+    return entry->documents;
+}
+
+void QueryResultCache::Insert(Key key, uint64_t generation, vector<Document> documents) {
+    //ключ хранят и список, и таблица; их узлы оцениваются четырьмя указателями
+    const size_t memory_usage = sizeof(Entry) + sizeof(Key) + sizeof(void*) * 4
+        + (key.query.plus_terms.size() + key.query.minus_terms.size()) * sizeof(SearchServer::TermId) * 2
+        + documents.size() * sizeof(Document);
+    if (memory_usage > shard_memory_limit_) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    //запрос мог найти и вставить другой поток
+    if (const auto it = shard.index.find(key); it != shard.index.end()) {
+        shard.memory_usage -= it->second->memory_usage;
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+    }
+    while (shard.memory_usage + memory_usage > shard_memory_limit_) {
+        const Entry& oldest = shard.entries.back();
+        shard.memory_usage -= oldest.memory_usage;
+        shard.index.erase(oldest.key);
+        shard.entries.pop_back();
+        ++evictions_;
+    }
+    shard.entries.push_front(Entry{move(key), generation, move(documents), memory_usage});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.memory_usage += memory_usage;
+}
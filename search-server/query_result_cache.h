@@ -0,0 +1,108 @@
+#pragma once
+
+#include "constants.h"
+#include "document.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct QueryCacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::size_t entry_count = 0;
+    std::size_t memory_usage = 0;
+};
+
+//Кеш результатов FindTopDocuments по статусу для одного сервера. Ключ - разобранный запрос:
+//запросы, которые отличаются только порядком и повторами слов или словами не из словаря,
+//дают один ключ. Результат помнит поколение индекса, при котором он найден; AddDocument,
+//RemoveDocument и SetRanking меняют поколение, и старый результат при следующем обращении
+//выбрасывается. Ключи делятся на части со своей блокировкой и своим списком LRU, каждая часть
+//занимает не больше memory_limit / shard_count байт. Кешем можно пользоваться из нескольких
+//потоков, пока сервер не меняется
+class QueryResultCache {
+public:
+    QueryResultCache(const SearchServer &search_server, std::size_t memory_limit, std::size_t shard_count = 16);
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT);
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT);
+
+    QueryCacheStats GetStats() const;
+
+    void Clear();
+
+private:
+    struct Key {
+        SearchServer::Query query;
+        DocumentStatus status;
+        std::size_t top_k;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key &key) const;
+    };
+
+    struct Entry {
+        Key key;
+        std::uint64_t generation;
+        std::vector<Document> documents;
+        std::size_t memory_usage;
+    };
+
+    //entries упорядочены от недавно использованных к давним
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        std::size_t memory_usage = 0;
+    };
+
+    const SearchServer& search_server_;
+    const std::size_t shard_memory_limit_;
+    std::vector<Shard> shards_;
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+
+    Key MakeKey(const std::string_view raw_query, DocumentStatus status, std::size_t top_k) const;
+
+    Shard& GetShard(const Key &key);
+
+    std::optional<std::vector<Document>> Find(const Key &key);
+
+    void Insert(Key key, std::uint64_t generation, std::vector<Document> documents);
+};
+
+template <class ExecutionPolicy>
+std::vector<Document> QueryResultCache::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query,
+                                                         DocumentStatus status, std::size_t top_k) {
+    Key key = MakeKey(raw_query, status, top_k);
+    if (auto documents = Find(key)) {
+        return std::move(*documents);
+    }
+    //поколение читается до поиска: результат не может оказаться новее своей метки
+    const std::uint64_t generation = search_server_.index_generation_;
+    SearchServer::QueryContext context;
+    std::vector<Document> documents;
+    search_server_.FindRankedDocuments(policy, key.query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, top_k, context, documents);
+    Insert(std::move(key), generation, documents);
+    return documents;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <variant>
+
+//tf слова, встретившегося count раз в документе из length слов
+inline double ComputeTermFreq(std::uint32_t count, std::uint32_t length) {
+    return static_cast<double>(count) / length;
+}
+
+//статистика неудалённых документов индекса
+struct CollectionStats {
+    int document_count = 0;
+    double average_document_length = 0.0;
+};
+
+//границы по документам из списка слова, по ним оценивается наибольший вклад слова в релевантность
+struct PostingBounds {
+    double max_term_freq = 0.0;
+    std::uint32_t max_count = 0;
+    std::uint32_t min_length = std::numeric_limits<std::uint32_t>::max();
+
+    void Add(std::uint32_t count, std::uint32_t length) {
+        max_term_freq = std::max(max_term_freq, ComputeTermFreq(count, length));
+        max_count = std::max(max_count, count);
+        min_length = std::min(min_length, length);
+    }
+};
+
+//Функция ранжирования задаёт вклад слова запроса в релевантность документа. Её методы
+//вызываются во внутреннем цикле поиска и встраиваются в него:
+//  ComputeTermWeight(stats, word_document_count) - вес слова, общий для всех документов;
+//  ComputeRelevance(stats, count, length, weight) - вклад слова, встретившегося count раз
+//      в документе из length слов;
+//  ComputeMaxRelevance(stats, bounds, weight) - вклад, не меньший вклада в любой документ списка
+
+//релевантность - сумма tf * log(N / n)
+struct TfIdf {
+    double ComputeTermWeight(const CollectionStats& stats, int word_document_count) const {
+        return std::log(stats.document_count * 1.0 / word_document_count);
+    }
+
+    double ComputeRelevance(const CollectionStats&, std::uint32_t count, std::uint32_t length, double weight) const {
+        return ComputeTermFreq(count, length) * weight;
+    }
+
+    double ComputeMaxRelevance(const CollectionStats&, const PostingBounds& bounds, double weight) const {
+        return bounds.max_term_freq * weight;
+    }
+};
+
+//Okapi BM25: k1 - насколько быстро насыщается вклад повторов слова, b - насколько сильно
+//длинный документ штрафуется относительно средней длины. Допустимы k1 >= 0 и 0 <= b <= 1,
+//их проверяет SearchServer::SetRanking
+struct Bm25 {
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double ComputeTermWeight(const CollectionStats& stats, int word_document_count) const {
+        return std::log(1.0 + (stats.document_count - word_document_count + 0.5) / (word_document_count + 0.5));
+    }
+
+    double ComputeRelevance(const CollectionStats& stats, std::uint32_t count, std::uint32_t length, double weight) const {
+        const double length_norm = 1.0 - b + b * length / stats.average_document_length;
+        return weight * count * (k1 + 1.0) / (count + k1 * length_norm);
+    }
+
+    //вклад растёт с числом вхождений и убывает с длиной документа
+    double ComputeMaxRelevance(const CollectionStats& stats, const PostingBounds& bounds, double weight) const {
+        return ComputeRelevance(stats, bounds.max_count, bounds.min_length, weight);
+    }
+};
+
+using RankingFunction = std::variant<TfIdf, Bm25>;
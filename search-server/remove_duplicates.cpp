@@ -1,31 +1,262 @@
 #include "remove_duplicates.h"
 
-#include <map>
-#include <set>
-#include <string>
-#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
 
 using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server) {
-    map<set<string_view>, int> id_documents_with_words; //в словаре автоматически останутся только недублированные наборы слов и id документов
-    set<string_view> set_of_words; //собираем наборы слов - ключи словаря
-    set<int> id_duplicates; //собираем id дубликатов
-    for (const int document_id : search_server) {
-        map<string_view, double> word_freq = search_server.GetWordFrequencies(document_id);
-        for (const auto& [word, tf] : word_freq) {
-            set_of_words.insert(word);
-        }
-        if (id_documents_with_words.count(set_of_words) == 0) {
-            id_documents_with_words.insert({set_of_words, document_id});
-        } else {
-            id_duplicates.insert(document_id);
+namespace {
+
+//перемешивание splitmix64: близкие номера слов дают независимые хеши
+uint64_t MixHash(uint64_t value) {
+    value += 0x9e3779b97f4a7c15;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+void HashCombine(uint64_t& seed, uint64_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
+} // namespace
+
+DuplicateDetector::DuplicateDetector(const SearchServer& search_server)
+    : search_server_(search_server) {
+    document_ids_.reserve(search_server.document_to_ordinal_.size());
+    document_terms_.reserve(search_server.document_to_ordinal_.size());
+    for (const auto [document_id, ordinal] : search_server.document_to_ordinal_) {
+        document_ids_.push_back(document_id);
+        document_terms_.push_back(search_server.GetTermCounts(search_server.documents_[ordinal]));
+    }
+}
+
+vector<DuplicateDocument> DuplicateDetector::FindExactDuplicates() const {
+    return FindExactDuplicatesImpl(execution::seq);
+}
+
+vector<DuplicateDocument> DuplicateDetector::FindExactDuplicates(const execution::sequenced_policy&) const {
+    return FindExactDuplicatesImpl(execution::seq);
+}
+
+vector<DuplicateDocument> DuplicateDetector::FindExactDuplicates(const execution::parallel_policy&) const {
+    return FindExactDuplicatesImpl(execution::par);
+}
+
+vector<DuplicateDocument> DuplicateDetector::FindNearDuplicates(const NearDuplicateOptions& options) const {
+    return FindNearDuplicatesImpl(execution::seq, options);
+}
+
+vector<DuplicateDocument> DuplicateDetector::FindNearDuplicates(const execution::sequenced_policy&,
+                                                                const NearDuplicateOptions& options) const {
+    return FindNearDuplicatesImpl(execution::seq, options);
+}
+
+vector<DuplicateDocument> DuplicateDetector::FindNearDuplicates(const execution::parallel_policy&,
+                                                                const NearDuplicateOptions& options) const {
+    return FindNearDuplicatesImpl(execution::par, options);
+}
+
+//документы с одинаковым хешем набора слов стоят рядом после сортировки; внутри такой группы
+//наборы сверяются с первыми документами уже найденных наборов, поэтому совпадение хешей
+//разных наборов не склеивает их
+template <class ExecutionPolicy>
+vector<size_t> DuplicateDetector::GroupExactDuplicates(const ExecutionPolicy& policy) const {
+    const size_t document_count = document_ids_.size();
+    vector<uint64_t> hashes(document_count);
+    ParallelFor(policy, document_count, [this, &hashes](size_t i) {
+        uint64_t hash = MixHash(document_terms_[i].size());
+        for (const auto [term, _] : document_terms_[i]) {
+            HashCombine(hash, MixHash(term));
+        }
+        hashes[i] = hash;
+    });
+
+    vector<size_t> order(document_count);
+    iota(order.begin(), order.end(), 0);
+    sort(policy, order.begin(), order.end(), [&hashes](size_t lhs, size_t rhs) {
+        return hashes[lhs] < hashes[rhs] || (hashes[lhs] == hashes[rhs] && lhs < rhs);
+    });
+
+    const auto is_same_terms = [this](size_t lhs, size_t rhs) {
+        return equal(document_terms_[lhs].begin(), document_terms_[lhs].end(),
+                     document_terms_[rhs].begin(), document_terms_[rhs].end(),
+                     [](const SearchServer::TermCount& lhs, const SearchServer::TermCount& rhs) {
+            return lhs.term == rhs.term;
+        });
+    };
+    vector<size_t> originals(document_count);
+    vector<size_t> group_originals;
+    for (size_t begin = 0; begin < document_count; ) {
+        size_t end = begin;
+        group_originals.clear();
+        for (; end < document_count && hashes[order[end]] == hashes[order[begin]]; ++end) {
+            const size_t i = order[end];
+            const auto it = find_if(group_originals.begin(), group_originals.end(), [&](size_t original) {
+                return is_same_terms(original, i);
+            });
+            if (it == group_originals.end()) {
+                group_originals.push_back(i);
+                originals[i] = i;
+            } else {
+                originals[i] = *it;
             }
-        set_of_words.clear();
+        }
+        begin = end;
     }
-    
-    for (const auto& id : id_duplicates) {
-        cout << "Found duplicate document id "s << id << endl;
-        search_server.RemoveDocument(id);
+    return originals;
+}
+
+template <class ExecutionPolicy>
+vector<DuplicateDocument> DuplicateDetector::FindExactDuplicatesImpl(const ExecutionPolicy& policy) const {
+    const vector<size_t> originals = GroupExactDuplicates(policy);
+    vector<DuplicateDocument> duplicates;
+    for (size_t i = 0; i < originals.size(); ++i) {
+        if (originals[i] != i) {
+            duplicates.push_back({document_ids_[i], document_ids_[originals[i]], 1.0});
+        }
+    }
+    return duplicates;
+}
+
+//Точные дубликаты склеиваются заранее, подписи считаются только для различных наборов слов.
+//Пары из одной корзины какой-нибудь полосы сверяются точно, затем наборы перебираются по
+//возрастанию id: набор - дубликат первого оставленного набора, с которым у него есть пара
+template <class ExecutionPolicy>
+vector<DuplicateDocument> DuplicateDetector::FindNearDuplicatesImpl(const ExecutionPolicy& policy,
+                                                                    const NearDuplicateOptions& options) const {
+    if (!(options.min_similarity > 0.0 && options.min_similarity <= 1.0) || options.band_count == 0
+        || options.rows_per_band == 0 || options.max_bucket_comparisons == 0) {
+        throw invalid_argument("Invalid near duplicate options"s);
+    }
+
+    const vector<size_t> originals = GroupExactDuplicates(policy);
+    vector<size_t> sets;
+    for (size_t i = 0; i < originals.size(); ++i) {
+        if (originals[i] == i) {
+            sets.push_back(i);
+        }
+    }
+
+    //ключи полос подписи: band_keys[set * band_count + band]
+    const size_t band_count = options.band_count;
+    const size_t rows_per_band = options.rows_per_band;
+    vector<uint64_t> band_keys(sets.size() * band_count);
+    ParallelFor(policy, sets.size(), [&](size_t set) {
+        //хеши слова для строк подписи - h1 + row * h2, минимум берётся по словам документа
+        vector<uint64_t> signature(band_count * rows_per_band, numeric_limits<uint64_t>::max());
+        for (const auto [term, _] : document_terms_[sets[set]]) {
+            const uint64_t h1 = MixHash(term ^ options.seed);
+            const uint64_t h2 = MixHash(h1) | 1;
+            uint64_t value = h1;
+            for (uint64_t& min_value : signature) {
+                min_value = min(min_value, value);
+                value += h2;
+            }
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = band;
+            for (size_t row = 0; row < rows_per_band; ++row) {
+                HashCombine(key, signature[band * rows_per_band + row]);
+            }
+            band_keys[set * band_count + band] = key;
+        }
+    });
+
+    //пары (позже, раньше) в номерах наборов; каждая полоса обрабатывается отдельно. Наборы
+    //корзины упорядочены по номеру, и каждый сверяется лишь с первыми наборами корзины
+    vector<vector<pair<size_t, size_t>>> band_pairs(band_count);
+    ParallelFor(policy, band_count, [&](size_t band) {
+        vector<pair<uint64_t, size_t>> buckets(sets.size());
+        for (size_t set = 0; set < sets.size(); ++set) {
+            buckets[set] = {band_keys[set * band_count + band], set};
+        }
+        sort(buckets.begin(), buckets.end());
+        for (size_t begin = 0; begin < buckets.size(); ) {
+            size_t end = begin + 1;
+            for (; end < buckets.size() && buckets[end].first == buckets[begin].first; ++end) {
+                for (size_t i = begin; i < min(end, begin + options.max_bucket_comparisons); ++i) {
+                    band_pairs[band].push_back({buckets[end].second, buckets[i].second});
+                }
+            }
+            begin = end;
+        }
+    });
+    vector<pair<size_t, size_t>> candidates;
+    for (auto& pairs : band_pairs) {
+        candidates.insert(candidates.end(), pairs.begin(), pairs.end());
+        pairs = {};
+    }
+    sort(policy, candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<double> similarities(candidates.size());
+    ParallelFor(policy, candidates.size(), [&](size_t i) {
+        similarities[i] = ComputeSimilarity(sets[candidates[i].first], sets[candidates[i].second]);
+    });
+
+    //набор, который сам оказался дубликатом, других наборов не удерживает
+    vector<size_t> set_originals(sets.size());
+    iota(set_originals.begin(), set_originals.end(), 0);
+    vector<double> set_similarities(sets.size(), 1.0);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const auto [later, earlier] = candidates[i];
+        if (set_originals[later] == later && set_originals[earlier] == earlier
+            && similarities[i] >= options.min_similarity) {
+            set_originals[later] = earlier;
+            set_similarities[later] = similarities[i];
+        }
+    }
+
+    //копия набора - дубликат того же документа, что и первый документ набора
+    vector<size_t> set_of_document(originals.size());
+    for (size_t set = 0; set < sets.size(); ++set) {
+        set_of_document[sets[set]] = set;
+    }
+    vector<DuplicateDocument> duplicates;
+    for (size_t i = 0; i < originals.size(); ++i) {
+        const size_t set = set_of_document[originals[i]];
+        if (set_originals[set] != set) {
+            duplicates.push_back({document_ids_[i], document_ids_[sets[set_originals[set]]], set_similarities[set]});
+        } else if (originals[i] != i) {
+            duplicates.push_back({document_ids_[i], document_ids_[originals[i]], 1.0});
+        }
+    }
+    return duplicates;
+}
+
+//мера Жаккара по отсортированным номерам слов; у двух пустых наборов она равна 1
+double DuplicateDetector::ComputeSimilarity(size_t lhs, size_t rhs) const {
+    const auto& lhs_terms = document_terms_[lhs];
+    const auto& rhs_terms = document_terms_[rhs];
+    size_t common_count = 0;
+    auto lhs_it = lhs_terms.begin();
+    auto rhs_it = rhs_terms.begin();
+    while (lhs_it != lhs_terms.end() && rhs_it != rhs_terms.end()) {
+        if (lhs_it->term < rhs_it->term) {
+            ++lhs_it;
+        } else if (rhs_it->term < lhs_it->term) {
+            ++rhs_it;
+        } else {
+            ++common_count;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    const size_t union_count = lhs_terms.size() + rhs_terms.size() - common_count;
+    return union_count == 0 ? 1.0 : common_count * 1.0 / union_count;
+}
+
+vector<DuplicateDocument> RemoveDuplicates(SearchServer& search_server) {
+    vector<DuplicateDocument> duplicates = DuplicateDetector(search_server).FindExactDuplicates(execution::par);
+    vector<int> duplicate_ids;
+    duplicate_ids.reserve(duplicates.size());
+    for (const DuplicateDocument& duplicate : duplicates) {
+        duplicate_ids.push_back(duplicate.document_id);
     }
+    search_server.RemoveDocuments(duplicate_ids);
+    return duplicates;
 }
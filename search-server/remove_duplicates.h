@@ -2,8 +2,75 @@
 
 #include "search_server.h"
 
+#include <cstddef>
+#include <cstdint>
+#include <execution>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
-void RemoveDuplicates(SearchServer& search_server);
+//документ document_id повторяет документ original_id с меньшим id, который остаётся
+struct DuplicateDocument {
+    int document_id;
+    int original_id;
+    double similarity;//мера Жаккара наборов слов
+};
+
+//Поиск почти дубликатов через MinHash и LSH: подпись документа - band_count * rows_per_band
+//минимумов хешей его слов, документы с совпавшей полосой подписи сверяются точно. Пара с
+//мерой Жаккара s находится с вероятностью 1 - (1 - s^rows_per_band)^band_count.
+//Документ корзины сверяется только с max_bucket_comparisons первыми по id документами той же
+//корзины, поэтому большая корзина даёт линейное, а не квадратичное число пар; в корзинах
+//крупнее max_bucket_comparisons + 1 документов оценка вероятности выше не гарантируется
+struct NearDuplicateOptions {
+    double min_similarity = 0.8;
+    std::size_t band_count = 32;
+    std::size_t rows_per_band = 4;
+    std::uint64_t seed = 0;
+    std::size_t max_bucket_comparisons = 16;
+};
+
+//Дубликаты документов сервера. Документы перебираются по возрастанию id, документ - дубликат,
+//если похож на один из оставленных до него; результат упорядочен по document_id. Точные
+//дубликаты ищутся по хешам наборов слов, совпадения хешей сверяются. Сервер не должен
+//меняться во время поиска
+class DuplicateDetector {
+public:
+    explicit DuplicateDetector(const SearchServer &search_server);
+
+    //документы с тем же набором слов без учёта повторов и стоп-слов
+    std::vector<DuplicateDocument> FindExactDuplicates() const;
+    std::vector<DuplicateDocument> FindExactDuplicates(const std::execution::sequenced_policy&) const;
+    std::vector<DuplicateDocument> FindExactDuplicates(const std::execution::parallel_policy&) const;
+
+    //документы, у которых мера Жаккара с оставленным документом не меньше options.min_similarity;
+    //пары, не попавшие в одну корзину LSH, пропускаются, ложных находок не бывает
+    std::vector<DuplicateDocument> FindNearDuplicates(const NearDuplicateOptions &options = {}) const;
+    std::vector<DuplicateDocument> FindNearDuplicates(const std::execution::sequenced_policy&,
+                                                      const NearDuplicateOptions &options = {}) const;
+    std::vector<DuplicateDocument> FindNearDuplicates(const std::execution::parallel_policy&,
+                                                      const NearDuplicateOptions &options = {}) const;
+
+private:
+    const SearchServer& search_server_;
+    //неудалённые документы по возрастанию id
+    std::vector<int> document_ids_;
+    std::vector<SearchServer::TermCountRange> document_terms_;
+
+    //для каждого документа - номер первого документа с тем же набором слов
+    template <class ExecutionPolicy>
+    std::vector<std::size_t> GroupExactDuplicates(const ExecutionPolicy &policy) const;
+
+    template <class ExecutionPolicy>
+    std::vector<DuplicateDocument> FindExactDuplicatesImpl(const ExecutionPolicy &policy) const;
+
+    template <class ExecutionPolicy>
+    std::vector<DuplicateDocument> FindNearDuplicatesImpl(const ExecutionPolicy &policy,
+                                                          const NearDuplicateOptions &options) const;
+
+    double ComputeSimilarity(std::size_t lhs, std::size_t rhs) const;
+};
+
+//удаляет точные дубликаты и возвращает их, выводить найденное - дело вызывающего
+std::vector<DuplicateDocument> RemoveDuplicates(SearchServer& search_server);
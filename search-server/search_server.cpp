@@ -2,42 +2,134 @@
 #include "log_duration.h"
 
 #include <execution>
+#include <limits>
 #include <map>
+#include <set>
 #include <string_view>
+#include <thread>
+#include <unordered_set>
 
 using namespace std;
 
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status,
                  const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    AddDocument(document_id, document, status, ratings, nullptr);
+}
+
+void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status,
+                 const vector<int>& ratings, shared_ptr<const void> storage) {
+    if ((document_id < 0) || (document_to_ordinal_.count(document_id) > 0)) {
         throw invalid_argument("Ошибка добавления документа"s);
     }
 
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, string(move(document))});
+    vector<TermId> terms = SplitIntoTermsNoStop(document);
 
-    const vector<string_view> words = SplitIntoWordsNoStop(documents_[document_id].document_text_);
+    const string_view text = storage ? texts_.Adopt(document, move(storage)) : texts_.Store(document);
+    InsertDocument(document_id, text, status, ComputeAverageRating(ratings), CountTerms(move(terms)));
+    ++index_generation_;
+}
 
-    const double inv_word_count = 1.0 / words.size();
-    for (const string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        id_with_word_and_freqs_[document_id][word] += inv_word_count;
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    AddDocuments(execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const execution::sequenced_policy&, const vector<NewDocument>& documents) {
+    AddDocumentsImpl(execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const execution::parallel_policy&, const vector<NewDocument>& documents) {
+    AddDocumentsImpl(execution::par, documents);
+}
+
+//1) параллельно разбиваем тексты на слова, проверяя их за тот же проход; 2) проверяем документы
+//по порядку, id и затем слова, как AddDocument, поэтому исключение называет первый ошибочный документ;
+//3) каждая часть пакета собирает свои новые слова, в словарь они вносятся одним проходом;
+//4) параллельно переводим слова в номера и считаем частоты; 5) дописываем документы в индекс
+template <class ExecutionPolicy>
+void SearchServer::AddDocumentsImpl(const ExecutionPolicy& policy, const vector<NewDocument>& documents) {
+    vector<optional<vector<string_view>>> valid_document_words(documents.size());
+    transform(policy, documents.begin(), documents.end(), valid_document_words.begin(), [](const NewDocument& document) {
+        return SplitIntoValidWordsView(document.text);
+    });
+    set<int> batch_ids;
+    vector<vector<string_view>> document_words(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const NewDocument& document = documents[i];
+        if (document.id < 0 || document_to_ordinal_.count(document.id) > 0 || !batch_ids.insert(document.id).second) {
+            throw invalid_argument("Ошибка добавления документа "s + to_string(document.id));
+        }
+        if (!valid_document_words[i]) {
+            throw invalid_argument("Words in document not valid: document "s + to_string(document.id));
+        }
+        document_words[i] = move(*valid_document_words[i]);
     }
 
-    document_ids_.insert(document_id);
+    //до записи в словарь искать в нём из нескольких потоков безопасно
+    const size_t part_count = max<size_t>(thread::hardware_concurrency(), 1);
+    const size_t part_size = max<size_t>((documents.size() + part_count - 1) / part_count, 1);
+    vector<size_t> part_begins;
+    for (size_t begin = 0; begin < documents.size(); begin += part_size) {
+        part_begins.push_back(begin);
+    }
+    vector<unordered_set<string_view>> part_new_words(part_begins.size());
+    transform(policy, part_begins.begin(), part_begins.end(), part_new_words.begin(), [&](size_t begin) {
+        unordered_set<string_view> new_words;
+        for (size_t i = begin; i < min(begin + part_size, documents.size()); ++i) {
+            for (const string_view word : document_words[i]) {
+                if (word_to_term_.count(word) == 0) {
+                    new_words.insert(word);
+                }
+            }
+        }
+        return new_words;
+    });
+    for (const auto& new_words : part_new_words) {
+        for (const string_view word : new_words) {
+            InternWord(word);
+        }
+    }
+
+    vector<vector<TermCount>> document_term_counts(documents.size());
+    transform(policy, document_words.begin(), document_words.end(), document_term_counts.begin(), [this](const vector<string_view>& words) {
+        vector<TermId> terms;
+        terms.reserve(words.size());
+        for (const string_view word : words) {
+            const TermId term = word_to_term_.find(word)->second;
+            if (!IsStopTerm(term)) {
+                terms.push_back(term);
+            }
+        }
+        return CountTerms(move(terms));
+    });
+
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const NewDocument& document = documents[i];
+        InsertDocument(document.id, texts_.Store(document.text), document.status, ComputeAverageRating(document.ratings),
+                       document_term_counts[i]);
+    }
+    ++index_generation_;
+}
+
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const string_view raw_query, DocumentStatus status,
+                                                       size_t top_k) const {
+    return FindTopDocuments(
+        context, raw_query, [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        }, top_k);
 }
 
-vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, size_t top_k) const {
     return FindTopDocuments(
         raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
             return document_status == status;
-        });
+        }, top_k);
 }
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_to_ordinal_.size();
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query,
@@ -48,34 +140,61 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const str
 //последовательный метод
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, 
                                                                         const string_view raw_query, int document_id) const {
+    QueryContext context;
+    const DocumentStatus status = get<1>(MatchDocument(context, raw_query, document_id));
+    return {move(context.matched_words_), status};
+}
+
+tuple<const vector<string_view>&, DocumentStatus> SearchServer::MatchDocument(QueryContext& context, const string_view raw_query,
+                                                                              int document_id) const {
     if (document_ids_.count(document_id) == 0) {
         throw out_of_range ("Document id is not valid"s);
     }
 
-    const auto query = ParseQuery(true, raw_query);
+    ParseQuery(true, raw_query, context.words_, context.query_);
+    const int ordinal = document_to_ordinal_.at(document_id);
 
-    vector<string_view> matched_words;
+    const auto& document_data = documents_[ordinal];
 
-    for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    vector<string_view>& matched_words = context.matched_words_;
+    matched_words.clear();
+
+    //слова документа и минус-слова запроса отсортированы по номеру, плюс-слова сортируются в буфере;
+    //слова запроса ищутся в словах документа галопом от предыдущей находки
+    const auto term_counts = GetTermCounts(document_data);
+    const auto find_term = [&term_counts](vector<TermCount>::const_iterator first, TermId term) {
+        return GallopingLowerBound(first, term_counts.end(), term, [](const TermCount& term_count, TermId value) {
+            return term_count.term < value;
+        });
+    };
+    auto it = term_counts.begin();
+    for (const TermId term : context.query_.minus_terms) {
+        it = find_term(it, term);
+        if (it == term_counts.end()) {
+            break;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            return {vector<string_view> {}, documents_.at(document_id).status};
+        if (it->term == term) {
+            return {matched_words, document_data.status};
         }
     }
 
-    for (const string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    vector<TermId>& plus_terms = context.terms_;
+    plus_terms.assign(context.query_.plus_terms.begin(), context.query_.plus_terms.end());
+    sort(plus_terms.begin(), plus_terms.end());
+    it = term_counts.begin();
+    for (const TermId term : plus_terms) {
+        it = find_term(it, term);
+        if (it == term_counts.end()) {
+            break;
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+        if (it->term == term) {
+            matched_words.push_back(words_[term]);
         }
     }
+    //слова возвращаются в порядке текста, как плюс-слова запроса
+    sort(matched_words.begin(), matched_words.end());
 
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, document_data.status};
 }
 
 //параллельный метод
@@ -86,28 +205,30 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
     }
 
     const auto query = ParseQuery(false, raw_query);
+    const int ordinal = document_to_ordinal_.at(document_id);
 
-    if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), [&, document_id](const string_view word) 
-            { if (word_to_document_freqs_.count(word) > 0) {
-                return word_to_document_freqs_.at(word).count(document_id) > 0;
-            }
-                return false; })) {
-        return {vector<string_view> {}, documents_.at(document_id).status};
+    const auto& document_data = documents_[ordinal];
+
+    if (any_of(execution::par, query.minus_terms.begin(), query.minus_terms.end(), [this, &document_data](const TermId term) 
+            { return HasTerm(document_data, term); })) {
+        return {vector<string_view> {}, document_data.status};
     }
 
-    vector<string_view> matched_words(query.plus_words.size());
+    vector<TermId> matched_terms(query.plus_terms.size());
 
-    auto it = copy_if(execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [&, document_id](const string_view word)
-              { if (word_to_document_freqs_.count(word) > 0) {
-                    return word_to_document_freqs_.at(word).count(document_id) > 0;
-                }
-                    return false;});
+    auto it = copy_if(execution::par, query.plus_terms.begin(), query.plus_terms.end(), matched_terms.begin(), [this, &document_data](const TermId term)
+              { return HasTerm(document_data, term); });
     
-    sort(execution::par, matched_words.begin(), it);
-    auto last = unique(execution::par, matched_words.begin(), it);
-    matched_words.erase(last, matched_words.end());
+    sort(execution::par, matched_terms.begin(), it);
+    auto last = unique(execution::par, matched_terms.begin(), it);
 
-    return {matched_words, documents_.at(document_id).status};
+    vector<string_view> matched_words(last - matched_terms.begin());
+    transform(matched_terms.begin(), last, matched_words.begin(), [this](const TermId term) {
+        return words_[term];
+    });
+    sort(matched_words.begin(), matched_words.end());
+
+    return {matched_words, document_data.status};
 }
 
 set<int>::const_iterator SearchServer::begin() {
@@ -122,13 +243,57 @@ size_t SearchServer::size() {
     return document_ids_.size();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static map<string_view, double> empty_frequencies;
-    if (!id_with_word_and_freqs_.count(document_id)) {
-        return empty_frequencies;
+SearchServer::WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto it = document_to_ordinal_.find(document_id);
+    if (it == document_to_ordinal_.end()) {
+        return WordFrequencies(*this, TermCountRange(term_counts_.end(), term_counts_.end()), 0);
+    }
+    return WordFrequencies(*this, GetTermCounts(documents_[it->second]), document_lengths_[it->second]);
+}
+
+SearchServer::WordFrequencies::WordFrequencies(const SearchServer& search_server, TermCountRange term_counts, uint32_t length)
+    : search_server_(&search_server)
+    , term_counts_(term_counts)
+    , length_(length) {
+}
+
+SearchServer::WordFrequencies::Iterator SearchServer::WordFrequencies::begin() const {
+    return Iterator(*search_server_, term_counts_.begin(), length_);
+}
+
+SearchServer::WordFrequencies::Iterator SearchServer::WordFrequencies::end() const {
+    return Iterator(*search_server_, term_counts_.end(), length_);
+}
+
+size_t SearchServer::WordFrequencies::size() const {
+    return term_counts_.size();
+}
+
+bool SearchServer::WordFrequencies::empty() const {
+    return term_counts_.size() == 0;
+}
+
+size_t SearchServer::WordFrequencies::count(const string_view word) const {
+    return Find(word) == term_counts_.end() ? 0 : 1;
+}
+
+double SearchServer::WordFrequencies::at(const string_view word) const {
+    const auto it = Find(word);
+    if (it == term_counts_.end()) {
+        throw out_of_range("Word is not in the document"s);
     }
+    return ComputeTermFreq(it->count, length_);
+}
 
-    return id_with_word_and_freqs_.at(document_id);
+vector<SearchServer::TermCount>::const_iterator SearchServer::WordFrequencies::Find(const string_view word) const {
+    const auto term = search_server_->FindTerm(word);
+    if (!term) {
+        return term_counts_.end();
+    }
+    const auto it = lower_bound(term_counts_.begin(), term_counts_.end(), *term, [](const TermCount& term_count, TermId value) {
+        return term_count.term < value;
+    });
+    return it != term_counts_.end() && it->term == *term ? it : term_counts_.end();
 }
 
 void SearchServer::RemoveDocument(int document_id) {
@@ -137,58 +302,459 @@ void SearchServer::RemoveDocument(int document_id) {
 
 //последовательный метод
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
-        if (document_ids_.count(document_id) == 0) {
+    if (document_ids_.count(document_id) == 0) {
         throw invalid_argument("Document id is not valid"s);
     }
 
-    for (const auto &[word, tf] : id_with_word_and_freqs_[document_id]) {
-        word_to_document_freqs_[word].erase(document_id);
+    const int ordinal = document_to_ordinal_.at(document_id);
+    auto& document_data = documents_[ordinal];
+    total_document_length_ -= document_lengths_[ordinal];
+    for (const auto [term, _] : GetTermCounts(document_data)) {
+        --word_to_document_freqs_[term].live_count;
     }
 
-    id_with_word_and_freqs_.erase(document_id);
-    documents_.erase(document_id);
+    //номер документа не переиспользуется, освобождаем список слов; текст остаётся в хранилище
+    is_live_ordinal_[ordinal] = false;
+    document_data.text = {};
+    document_data.last_term = document_data.first_term;
+    document_to_ordinal_.erase(document_id);
     document_ids_.erase(document_id);
+    ++index_generation_;
+    CompactIndex(execution::seq);
 }
 
-//параллельный метод
+//параллельный метод: одно удаление почти не распараллеливается, параллельным остаётся сжатие индекса
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    if (document_ids_.count(document_id) == 0) {
-        throw invalid_argument("Document id is not valid"s);
+    RemoveDocumentsImpl(execution::par, {document_id});
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocuments(execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const execution::sequenced_policy&, const vector<int>& document_ids) {
+    RemoveDocumentsImpl(execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const execution::parallel_policy&, const vector<int>& document_ids) {
+    RemoveDocumentsImpl(execution::par, document_ids);
+}
+
+//счётчики документов слов уменьшают потоки, каждый в своём непрерывном диапазоне номеров слов:
+//списки слов документов отсортированы, поэтому поток находит начало своего диапазона поиском,
+//и два потока никогда не пишут в один счётчик
+template <class ExecutionPolicy>
+void SearchServer::RemoveDocumentsImpl(const ExecutionPolicy& policy, const vector<int>& document_ids) {
+    set<int> batch_ids;
+    for (const int document_id : document_ids) {
+        if (document_ids_.count(document_id) == 0 || !batch_ids.insert(document_id).second) {
+            throw invalid_argument("Document id is not valid: "s + to_string(document_id));
+        }
+    }
+    vector<int> ordinals;
+    ordinals.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        ordinals.push_back(document_to_ordinal_.at(document_id));
+    }
+
+    const size_t term_count = words_.size();
+    const size_t part_count = is_same_v<ExecutionPolicy, execution::sequenced_policy> ? 1 : max<size_t>(thread::hardware_concurrency(), 1) * 4;
+    const size_t part_size = max<size_t>((term_count + part_count - 1) / part_count, 1);
+    vector<size_t> part_begins;
+    for (size_t begin = 0; begin < term_count; begin += part_size) {
+        part_begins.push_back(begin);
+    }
+    for_each(policy, part_begins.begin(), part_begins.end(), [&](size_t begin) {
+        const size_t end = min(begin + part_size, term_count);
+        for (const int ordinal : ordinals) {
+            const auto term_counts = GetTermCounts(documents_[ordinal]);
+            auto it = lower_bound(term_counts.begin(), term_counts.end(), begin, [](const TermCount& term_count, size_t term) {
+                return term_count.term < term;
+            });
+            for (; it != term_counts.end() && it->term < end; ++it) {
+                --word_to_document_freqs_[it->term].live_count;
+            }
+        }
+    });
+
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        auto& document_data = documents_[ordinals[i]];
+        total_document_length_ -= document_lengths_[ordinals[i]];
+        is_live_ordinal_[ordinals[i]] = false;
+        document_data.text = {};
+        document_data.last_term = document_data.first_term;
+        document_to_ordinal_.erase(document_ids[i]);
+        document_ids_.erase(document_ids[i]);
+    }
+    ++index_generation_;
+    CompactIndex(policy);
+}
+
+template <class ExecutionPolicy>
+void SearchServer::CompactIndex(const ExecutionPolicy& policy) {
+    const size_t removed_count = documents_.size() - document_to_ordinal_.size();
+    if (removed_count * 2 <= documents_.size()) {
+        return;
+    }
+
+    //слова удалённых документов выпадают из прямого индекса
+    vector<int> new_ordinals(documents_.size(), -1);
+    deque<DocumentData> documents;
+    vector<uint32_t> document_lengths;
+    vector<TermCount> term_counts;
+    for (size_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        if (is_live_ordinal_[ordinal]) {
+            new_ordinals[ordinal] = static_cast<int>(documents.size());
+            const auto document_term_counts = GetTermCounts(documents_[ordinal]);
+            documents.push_back(move(documents_[ordinal]));
+            documents.back().first_term = term_counts.size();
+            documents.back().last_term = term_counts.size() + document_term_counts.size();
+            term_counts.insert(term_counts.end(), document_term_counts.begin(), document_term_counts.end());
+            document_lengths.push_back(document_lengths_[ordinal]);
+        }
+    }
+
+    //стоп-слова остаются в словаре всегда
+    const TermId no_term = numeric_limits<TermId>::max();
+    vector<TermId> new_terms(words_.size(), no_term);
+    vector<string_view> words;
+    for (TermId term = 0; term < words_.size(); ++term) {
+        if (term < stop_term_count_ || word_to_document_freqs_[term].live_count > 0) {
+            new_terms[term] = static_cast<TermId>(words.size());
+            words.push_back(words_[term]);
+        }
+    }
+
+    vector<PostingList> posting_lists(words.size());
+    vector<TermId> old_terms(words.size());
+    for (TermId term = 0; term < words_.size(); ++term) {
+        if (new_terms[term] != no_term) {
+            old_terms[new_terms[term]] = term;
+        }
     }
-        vector<const string_view*> remove_words(id_with_word_and_freqs_[document_id].size());
-        transform(execution::par, id_with_word_and_freqs_[document_id].begin(), id_with_word_and_freqs_[document_id].end(), remove_words.begin(), [](const auto &it)
-                  { auto p = &it.first;
-                    return p; });
+    //каждый список переписывается независимо от других
+    transform(policy, old_terms.begin(), old_terms.end(), posting_lists.begin(), [this, &new_ordinals, &document_lengths](TermId term) {
+        const PostingList& old_posting_list = word_to_document_freqs_[term];
+        PostingList posting_list;
+        posting_list.postings.reserve(old_posting_list.live_count);
+        for (PostingCursor cursor(*this, old_posting_list, {0, static_cast<int>(documents_.size())});
+             cursor.GetOrdinal() < static_cast<int>(documents_.size()); cursor.Next()) {
+            const int new_ordinal = new_ordinals[cursor.GetOrdinal()];
+            if (new_ordinal >= 0) {
+                posting_list.postings.push_back({new_ordinal, cursor.GetCount()});
+                posting_list.bounds.Add(cursor.GetCount(), document_lengths[new_ordinal]);
+            }
+        }
+        posting_list.live_count = old_posting_list.live_count;
+        return posting_list;
+    });
+    //перенумерация сохраняет порядок слов, слова документов остаются отсортированными
+    for_each(policy, term_counts.begin(), term_counts.end(), [&new_terms](TermCount& term_count) {
+        term_count.term = new_terms[term_count.term];
+    });
+
+    //текст удалённых документов и выпавших слов из своих блоков освобождается вместе со старым
+    //хранилищем; текст из внешних буферов (AddDocument со storage, LoadIndex) остаётся на месте
+    TextArena texts = texts_.CopyExternalStorages();
+    for (string_view& word : words) {
+        word = texts_.Relocate(word, texts);
+    }
+    for (DocumentData& document_data : documents) {
+        document_data.text = texts_.Relocate(document_data.text, texts);
+    }
+
+    word_to_term_.clear();
+    for (TermId term = 0; term < words.size(); ++term) {
+        word_to_term_.emplace(words[term], term);
+    }
+    for (auto& [document_id, ordinal] : document_to_ordinal_) {
+        ordinal = new_ordinals[ordinal];
+    }
+    words_ = move(words);
+    texts_ = move(texts);
+    word_to_document_freqs_ = move(posting_lists);
+    documents_ = move(documents);
+    term_counts_ = move(term_counts);
+    document_lengths_ = move(document_lengths);
+    is_live_ordinal_.assign(documents_.size(), true);
+    if (are_postings_compressed_) {
+        for_each(policy, word_to_document_freqs_.begin(), word_to_document_freqs_.end(), [this](PostingList& posting_list) {
+            SealPostings(posting_list, true);
+        });
+    }
+}
+
+void SearchServer::CompressPostings() {
+    are_postings_compressed_ = true;
+    for (PostingList& posting_list : word_to_document_freqs_) {
+        SealPostings(posting_list, true);
+    }
+}
+
+void SearchServer::SetRanking(const RankingFunction& ranking) {
+    //оценка сверху в Bm25::ComputeMaxRelevance верна только при таких параметрах
+    if (const Bm25* bm25 = get_if<Bm25>(&ranking); bm25 && !(bm25->k1 >= 0.0 && bm25->b >= 0.0 && bm25->b <= 1.0)) {
+        throw invalid_argument("BM25 requires k1 >= 0 and 0 <= b <= 1"s);
+    }
+    ranking_ = ranking;
+    //кешированные веса слов посчитаны прежней функцией
+    ++index_generation_;
+}
+
+CollectionStats SearchServer::GetCollectionStats() const {
+    const int document_count = GetDocumentCount();
+    return {document_count, document_count > 0 ? total_document_length_ * 1.0 / document_count : 0.0};
+}
+
+size_t SearchServer::GetPostingsMemoryUsage() const {
+    size_t memory_usage = word_to_document_freqs_.capacity() * sizeof(PostingList);
+    for (const PostingList& posting_list : word_to_document_freqs_) {
+        memory_usage += posting_list.blocks.GetMemoryUsage() + posting_list.postings.capacity() * sizeof(Posting);
+    }
+    return memory_usage;
+}
 
-        for_each(execution::par, remove_words.begin(), remove_words.end(), [&, document_id](const auto &it) 
-        { word_to_document_freqs_[*it].erase(document_id); });
+size_t SearchServer::GetTextMemoryUsage() const {
+    return texts_.GetMemoryUsage();
+}
+
+void SearchServer::SealPostings(PostingList& posting_list, bool is_last_block_sealed) const {
+    const size_t block_size = CompressedPostings::block_size_;
+    const size_t sealed_count = is_last_block_sealed ? posting_list.postings.size()
+                                                     : posting_list.postings.size() / block_size * block_size;
+    if (sealed_count == 0) {
+        return;
+    }
+    int ordinals[block_size];
+    uint32_t counts[block_size];
+    for (size_t begin = 0; begin < sealed_count; begin += block_size) {
+        const size_t count = min(block_size, sealed_count - begin);
+        for (size_t i = 0; i < count; ++i) {
+            ordinals[i] = posting_list.postings[begin + i].ordinal;
+            counts[i] = posting_list.postings[begin + i].count;
+        }
+        posting_list.blocks.AppendBlock(ordinals, counts, count);
+    }
+    posting_list.postings.erase(posting_list.postings.begin(), posting_list.postings.begin() + sealed_count);
+    posting_list.postings.shrink_to_fit();
+}
 
-        id_with_word_and_freqs_.erase(document_id);
-        documents_.erase(document_id);
-        document_ids_.erase(document_id);
+void SearchServer::InternStopWords() {
+    for (const string& word : stop_words_) {
+        InternWord(word);
+    }
+    stop_term_count_ = static_cast<TermId>(words_.size());
+}
+
+SearchServer::TermId SearchServer::InternWord(const string_view word) {
+    const auto it = word_to_term_.find(word);
+    if (it != word_to_term_.end()) {
+        return it->second;
+    }
+    const TermId term = static_cast<TermId>(words_.size());
+    words_.push_back(texts_.Store(word));
+    word_to_term_.emplace(words_.back(), term);
+    word_to_document_freqs_.emplace_back();
+    return term;
 }
 
-bool SearchServer::IsStopWord(const string_view word) const {
-    return stop_words_.count(word) > 0;
+optional<SearchServer::TermId> SearchServer::FindTerm(const string_view word) const {
+    const auto it = word_to_term_.find(word);
+    if (it == word_to_term_.end()) {
+        return nullopt;
+    }
+    return it->second;
 }
 
+bool SearchServer::IsStopTerm(TermId term) const {
+    return term < stop_term_count_;
+}
 bool SearchServer::IsValidWord(const string_view word) {
     return none_of(word.begin(), word.end(), [](char c) {
         return c >= '\0' && c < ' ';
     });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view text) const {
-    vector<string_view> words;
-    for (const string_view word : SplitIntoWordsView(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Words in document not valid"s);
+//сначала проверяем все слова, чтобы при ошибке в словарь не попало ничего лишнего
+vector<SearchServer::TermId> SearchServer::SplitIntoTermsNoStop(const string_view text) {
+    const auto words = SplitIntoValidWordsView(text);
+    if (!words) {
+        throw invalid_argument("Words in document not valid"s);
+    }
+
+    vector<TermId> terms;
+    terms.reserve(words->size());
+    for (const string_view word : *words) {
+        const TermId term = InternWord(word);
+        if (!IsStopTerm(term)) {
+            terms.push_back(term);
+        }
+    }
+    return terms;
+}
+
+//при равных релевантности и рейтинге порядок задаёт id, чтобы отбор top_k не зависел от порядка обхода
+bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < EPSILON()) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    } else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
+//диапазоны номеров документов для параллельного поиска: по несколько на поток,
+//чтобы потоки, получившие диапазоны с короткими списками, не простаивали
+vector<SearchServer::OrdinalRange> SearchServer::SplitOrdinals() const {
+    const int min_range_size = 4096;
+    const int ordinal_count = static_cast<int>(documents_.size());
+    const int range_count = max(1, min(ordinal_count / min_range_size, static_cast<int>(thread::hardware_concurrency()) * 4));
+    const int range_size = (ordinal_count + range_count - 1) / range_count;
+
+    vector<OrdinalRange> ranges;
+    for (int first = 0; first < ordinal_count; first += range_size) {
+        ranges.push_back({first, min(first + range_size, ordinal_count)});
+    }
+    return ranges;
+}
+
+//вместо полной сортировки упорядочиваем только первые top_k документов
+void SearchServer::SelectTopDocuments(vector<Document>& documents, size_t top_k) {
+    if (documents.size() > top_k) {
+        partial_sort(documents.begin(), documents.begin() + top_k, documents.end(), IsMoreRelevant);
+        documents.resize(top_k);
+        //результаты пакета запросов хранятся все сразу, не держим память всех найденных документов
+        documents.shrink_to_fit();
+    } else {
+        sort(documents.begin(), documents.end(), IsMoreRelevant);
+    }
+}
+
+SearchServer::PostingCursor::PostingCursor(const SearchServer& search_server, const PostingList& posting_list,
+                                           OrdinalRange range)
+    : search_server_(&search_server)
+    , posting_list_(&posting_list)
+    , last_(range.last) {
+    LoadBlock(posting_list.blocks.FindBlock(0, range.first));
+    Update();
+    Seek(range.first);
+}
+
+//блоки, в которых все номера меньше ordinal, пропускаются по заголовкам без распаковки.
+//Курсоры минус-слов и отстающих плюс-слов догоняют номер галопом, поэтому проход по частому
+//слову стоит O(log расстояния) на проверяемый документ, а не длину его списка
+void SearchServer::PostingCursor::Seek(int ordinal) {
+    if (ordinal <= ordinal_) {
+        return;
+    }
+    if (!is_tail_ && ordinal > posting_list_->blocks.GetLastOrdinal(block_)) {
+        LoadBlock(posting_list_->blocks.FindBlock(block_ + 1, ordinal));
+    }
+    if (is_tail_) {
+        const auto& postings = posting_list_->postings;
+        position_ = GallopingLowerBound(postings.begin() + position_, postings.end(), ordinal,
+                                        [](const Posting& posting, int value) {
+            return posting.ordinal < value;
+        }) - postings.begin();
+    } else {
+        position_ = GallopingLowerBound(block_ordinals_ + position_, block_ordinals_ + size_, ordinal) - block_ordinals_;
+    }
+    Update();
+}
+
+void SearchServer::PostingCursor::LoadBlock(size_t block) {
+    block_ = block;
+    position_ = 0;
+    is_tail_ = block == posting_list_->blocks.GetBlockCount();
+    if (is_tail_) {
+        size_ = posting_list_->postings.size();
+    } else {
+        posting_list_->blocks.DecodeOrdinals(block, block_ordinals_);
+        are_counts_decoded_ = false;
+        size_ = posting_list_->blocks.GetBlockSize(block);
+    }
+}
+
+//каждый поток отбирает top_k в своей части, затем из кандидатов отбираем итоговые top_k
+
+SearchServer::TermCountRange SearchServer::GetTermCounts(const DocumentData& document_data) const {
+    return TermCountRange(term_counts_.begin() + document_data.first_term, term_counts_.begin() + document_data.last_term);
+}
+
+bool SearchServer::HasTerm(const DocumentData& document_data, TermId term) const {
+    const auto term_counts = GetTermCounts(document_data);
+    return binary_search(term_counts.begin(), term_counts.end(), TermCount{term, 0},
+                         [](const TermCount& lhs, const TermCount& rhs) {
+        return lhs.term < rhs.term;
+    });
+}
+
+void SearchServer::AppendDocuments(const SearchServer& other, const set<int>& excluded_ids) {
+    //номера слов другого словаря переводятся в свои при первой встрече
+    const TermId no_term = numeric_limits<TermId>::max();
+    vector<TermId> own_terms(other.words_.size(), no_term);
+    for (const auto [document_id, ordinal] : other.document_to_ordinal_) {
+        if (excluded_ids.count(document_id) > 0) {
+            continue;
+        }
+        const DocumentData& document_data = other.documents_[ordinal];
+        const auto other_term_counts = other.GetTermCounts(document_data);
+        vector<TermCount> term_counts;
+        term_counts.reserve(other_term_counts.size());
+        for (const auto [term, count] : other_term_counts) {
+            if (own_terms[term] == no_term) {
+                own_terms[term] = InternWord(other.words_[term]);
+            }
+            term_counts.push_back({own_terms[term], count});
         }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+        sort(term_counts.begin(), term_counts.end(), [](const TermCount& lhs, const TermCount& rhs) {
+            return lhs.term < rhs.term;
+        });
+        InsertDocument(document_id, texts_.Store(document_data.text), document_data.status, document_data.rating,
+                       term_counts);
+    }
+    ++index_generation_;
+}
+
+vector<SearchServer::TermCount> SearchServer::CountTerms(vector<TermId> terms) {
+    sort(terms.begin(), terms.end());
+    vector<TermCount> term_counts;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (i == 0 || terms[i] != terms[i - 1]) {
+            term_counts.push_back({terms[i], 0});
+        }
+        ++term_counts.back().count;
+    }
+    return term_counts;
+}
+
+void SearchServer::InsertDocument(int document_id, string_view text, DocumentStatus status, int rating,
+                                  const vector<TermCount>& term_counts) {
+    const int ordinal = static_cast<int>(documents_.size());
+    uint32_t length = 0;
+    for (const auto [_, count] : term_counts) {
+        length += count;
+    }
+    document_lengths_.push_back(length);
+    total_document_length_ += length;
+    //номер нового документа больше всех выданных, поэтому списки остаются отсортированными
+    for (const auto [term, count] : term_counts) {
+        PostingList& posting_list = word_to_document_freqs_[term];
+        posting_list.postings.push_back({ordinal, count});
+        ++posting_list.live_count;
+        posting_list.bounds.Add(count, length);
+        if (are_postings_compressed_ && posting_list.postings.size() == CompressedPostings::block_size_) {
+            SealPostings(posting_list, false);
         }
     }
-    return words;
+    is_live_ordinal_.push_back(true);
+    documents_.push_back(DocumentData{document_id, rating, status, text, term_counts_.size(),
+                                      term_counts_.size() + term_counts.size()});
+    term_counts_.insert(term_counts_.end(), term_counts.begin(), term_counts.end());
+    document_to_ordinal_.emplace(document_id, ordinal);
+    document_ids_.insert(document_id);
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -216,40 +782,62 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
     if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
         throw invalid_argument("Query word is invalid");
     }
-    return {word, is_minus, IsStopWord(word)};
+    return {word, is_minus, stop_words_.count(word) > 0};
 }
 
 SearchServer::Query SearchServer::ParseQuery(bool flag, const string_view text) const {
+    vector<string_view> words;
+    Query result;
+    ParseQuery(flag, text, words, result);
+    return result;
+}
+
+void SearchServer::ParseQuery(bool flag, const string_view text, vector<string_view>& words, Query& result) const {
     if (text.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
 
-    Query result;
-    for (const string_view word : SplitIntoWordsView(text)) {
+    SplitIntoWordsView(text, words);
+    result.plus_terms.clear();
+    result.minus_terms.clear();
+    for (const string_view word : words) {
         const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
-            } else {
-                result.plus_words.push_back(query_word.data);
-            }
+        const auto term = FindTerm(query_word.data);
+        if (!term || IsStopTerm(*term)) {
+            continue;
+        }
+        if (query_word.is_minus) {
+            result.minus_terms.push_back(*term);
+        } else {
+            result.plus_terms.push_back(*term);
         }
     }
     //для параллельного метода Match не делаем сортировку в ParseQuery
     if(flag){
-        sort(result.minus_words.begin(), result.minus_words.end());
-        auto it1 = unique(result.minus_words.begin(), result.minus_words.end());
-        result.minus_words.erase(it1, result.minus_words.end());
+        sort(result.minus_terms.begin(), result.minus_terms.end());
+        auto it1 = unique(result.minus_terms.begin(), result.minus_terms.end());
+        result.minus_terms.erase(it1, result.minus_terms.end());
  
-        sort(result.plus_words.begin(), result.plus_words.end());
-        auto it2 = unique(result.plus_words.begin(), result.plus_words.end());
-        result.plus_words.erase(it2, result.plus_words.end());
+        //плюс-слова упорядочены по тексту: от порядка сложения зависят младшие биты релевантности
+        sort(result.plus_terms.begin(), result.plus_terms.end(), [this](TermId lhs, TermId rhs) {
+            return words_[lhs] < words_[rhs];
+        });
+        auto it2 = unique(result.plus_terms.begin(), result.plus_terms.end());
+        result.plus_terms.erase(it2, result.plus_terms.end());
     }
-
-    return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term) const {
+    const PostingList& posting_list = word_to_document_freqs_[term];
+    if (posting_list.idf.generation.load(memory_order_acquire) != index_generation_) {
+        //у слова без документов idf не используется: ни один документ с ним не совпадёт
+        const CollectionStats stats = GetCollectionStats();
+        const double value = posting_list.live_count == 0 ? 0.0 : visit([&stats, &posting_list](const auto& ranking) {
+            return ranking.ComputeTermWeight(stats, posting_list.live_count);
+        }, ranking_);
+        posting_list.idf.value.store(value, memory_order_relaxed);
+        posting_list.idf.generation.store(index_generation_, memory_order_release);
+    }
+    return posting_list.idf.value.load(memory_order_relaxed);
 }
 
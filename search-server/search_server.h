@@ -1,21 +1,35 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cmath>
+#include <deque>
 #include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 #include <iterator>
+#include <limits>
 #include <execution>
 #include <string_view>
+#include <unordered_map>
+#include <variant>
 
-#include "concurrent_map.h"
+#include "compressed_postings.h"
 #include "constants.h"
 #include "document.h"
+#include "galloping_search.h"
+#include "paginator.h"
+#include "query_executor.h"
+#include "ranking.h"
 #include "string_processing.h"
+#include "text_arena.h"
 
 //const int MAX_RESULT_DOCUMENT_COUNT = 5;
 //constexpr double EPSILON() { return 1e-6; }
@@ -29,6 +43,7 @@ public:
             using namespace std;
             throw invalid_argument("Стоп-слова содержат спецсимволы"s);
         }
+        InternStopWords();
     }
 
     explicit SearchServer(const std::string& stop_words_text)
@@ -43,16 +58,31 @@ public:
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
                      const std::vector<int> &ratings);
+    //текст документа не копируется: storage владеет буфером с document (например, отображённым
+    //в память файлом корпуса), сервер держит его, пока жив; при пустом storage текст копируется
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+                     const std::vector<int> &ratings, std::shared_ptr<const void> storage);
+
+    //пакетное добавление: либо добавляются все документы, либо ни одного, а исключение
+    //называет id первого ошибочного документа
+    void AddDocuments(const std::vector<NewDocument> &documents);
+    void AddDocuments(const std::execution::sequenced_policy&, const std::vector<NewDocument> &documents);
+    void AddDocuments(const std::execution::parallel_policy&, const std::vector<NewDocument> &documents);
 
+    //top_k - сколько лучших документов вернуть
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view raw_query,
-                                           DocumentPredicate document_predicate) const;
+                                           DocumentPredicate document_predicate,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
     template <class ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query,
-                                    DocumentPredicate document_predicate) const;
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
+                                    DocumentPredicate document_predicate,
+                                    std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
     template <class ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query, DocumentStatus status,
+                                           std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
     template <class ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy &policy, const std::string_view raw_query) const;
@@ -65,39 +95,209 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, 
                                                                         const std::string_view raw_query, int document_id) const;
 
+    //память для запросов одного потока, см. ниже
+    class QueryContext;
+
+    //Последовательный поиск в памяти контекста: когда его буферы выросли до размеров запроса,
+    //повторные запросы не выделяют память в куче. Результат лежит в контексте и действителен
+    //до следующего запроса с этим контекстом
+    template <typename DocumentPredicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext &context, const std::string_view raw_query,
+                                                  DocumentPredicate document_predicate,
+                                                  std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    const std::vector<Document>& FindTopDocuments(QueryContext &context, const std::string_view raw_query,
+                                                  DocumentStatus status = DocumentStatus::ACTUAL,
+                                                  std::size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::tuple<const std::vector<std::string_view>&, DocumentStatus> MatchDocument(QueryContext &context,
+                                                                               const std::string_view raw_query,
+                                                                               int document_id) const;
+
     std::set<int>::const_iterator begin();
 
     std::set<int>::const_iterator end();
 
     std::size_t size();
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    //слова документа с их tf, не по алфавиту, см. ниже
+    class WordFrequencies;
 
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    //Удаление, после которого удалена больше половины документов, уплотняет индекс. Тогда текст,
+    //скопированный сервером, переезжает, и string_view из MatchDocument и GetWordFrequencies,
+    //указывающие в него, становятся недействительными; текст внешних буферов остаётся на месте
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
+    //пакетное удаление: либо удаляются все документы, либо ни одного, а исключение называет
+    //id первого ошибочного; параллельная версия делит между потоками номера слов
+    void RemoveDocuments(const std::vector<int> &document_ids);
+    void RemoveDocuments(const std::execution::sequenced_policy&, const std::vector<int> &document_ids);
+    void RemoveDocuments(const std::execution::parallel_policy&, const std::vector<int> &document_ids);
+
+    //сохраняет индекс в двоичный файл с номером версии формата; номера документов уплотняются.
+    //Файл заменяется целиком, поэтому можно сохранять поверх файла, из которого загружен сервер
+    void SaveIndex(const std::string &path) const;
+    //загружает сохранённый индекс: файл отображается в память, текст документов и слов
+    //читается прямо из него, прямой индекс и списки документов копируются в память сервера
+    //блоками и проверяются за один проход. Повреждённый или не согласованный файл - runtime_error
+    static SearchServer LoadIndex(const std::string &path);
+
+    //функция ранжирования для следующих запросов, по умолчанию TfIdf. Выбор проверяется один раз
+    //на запрос, внутренний цикл поиска скомпилирован для каждой функции отдельно. Параметры
+    //Bm25 вне k1 >= 0, 0 <= b <= 1 - invalid_argument, прежняя функция остаётся
+    void SetRanking(const RankingFunction &ranking);
+
+    //число неудалённых документов и их средняя длина в словах без стоп-слов
+    CollectionStats GetCollectionStats() const;
+
+    //сжимает списки документов (см. CompressedPostings): они занимают в несколько раз меньше
+    //памяти, поиск распаковывает блоки на лету. Новые документы копятся в несжатом хвосте
+    //списка и сжимаются, когда их набирается на целый блок
+    void CompressPostings();
+
+    //память, занятая списками документов слов
+    std::size_t GetPostingsMemoryUsage() const;
+    //память, занятая текстом документов и слов; текст в отображённом файле не учитывается
+    std::size_t GetTextMemoryUsage() const;
 
 private:
+    //сегменты составного индекса опрашиваются и сливаются через внутренние структуры
+    friend class IndexSnapshot;
+    friend class ConcurrentSearchServer;
+    //кеш результатов разбирает запросы и сверяет поколение индекса
+    friend class QueryResultCache;
+    //поиск дубликатов сравнивает номера слов документов
+    friend class DuplicateDetector;
+
+    //номер слова в словаре сервера
+    using TermId = std::uint32_t;
+
+    //число вхождений слова в документ
+    struct TermCount {
+        TermId term;
+        std::uint32_t count;
+    };
+
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
-        std::string document_text_;
+        std::string_view text;
+        //слова документа - term_counts_[first_term, last_term), отсортированы по номеру слова
+        std::size_t first_term;
+        std::size_t last_term;
+    };
+
+    using TermCountRange = IteratorRange<std::vector<TermCount>::const_iterator>;
+
+    //элемент списка документов слова, списки отсортированы по порядковому номеру документа
+    struct Posting {
+        int ordinal;
+        std::uint32_t count;
+    };
+
+    //idf слова, вычисленный для поколения индекса generation (0 - ещё не вычислялся).
+    //Пересчитывается при первом запросе после AddDocument/RemoveDocument; одновременные
+    //пересчёты из разных потоков записывают одно и то же значение
+    struct CachedIdf {
+        std::atomic<std::uint64_t> generation{0};
+        std::atomic<double> value{0.0};
+
+        CachedIdf() = default;
+        CachedIdf(const CachedIdf& other)
+            : generation(other.generation.load())
+            , value(other.value.load()) {
+        }
+        CachedIdf& operator=(const CachedIdf& other) {
+            generation = other.generation.load();
+            value = other.value.load();
+            return *this;
+        }
+    };
+
+    //удалённые документы остаются в списке до уплотнения индекса, live_count их не учитывает.
+    //bounds - границы по документам списка, после удаления документов могут быть завышены.
+    //Список начинается сжатыми блоками blocks, за ними идут несжатые postings
+    struct PostingList {
+        CompressedPostings blocks;
+        std::vector<Posting> postings;
+        int live_count = 0;
+        PostingBounds bounds;
+        mutable CachedIdf idf;
     };
     
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;//хранится текст документа в виде string
+    //текст документов и слов словаря; уплотнение индекса переносит живой свой текст в новое хранилище
+    TextArena texts_;
+    //словарь: текст слова по номеру и номер по тексту; стоп-слова получают номера [0, stop_term_count_)
+    std::vector<std::string_view> words_;
+    std::unordered_map<std::string_view, TermId> word_to_term_;
+    TermId stop_term_count_ = 0;
+    //списки документов по номеру слова
+    std::vector<PostingList> word_to_document_freqs_;
+    //меняется при каждом добавлении и удалении документа
+    std::uint64_t index_generation_ = 1;
+    //документы по порядковым номерам, номера выдаются при добавлении и не переиспользуются
+    std::deque<DocumentData> documents_;
+    //прямой индекс: слова всех документов подряд в порядке номеров; у удалённых документов
+    //слова остаются в массиве до уплотнения индекса
+    std::vector<TermCount> term_counts_;
+    //число слов документа без стоп-слов по порядковому номеру; tf считается при поиске из числа вхождений и длины
+    std::vector<std::uint32_t> document_lengths_;
+    //сумма длин неудалённых документов, для средней длины в BM25
+    std::uint64_t total_document_length_ = 0;
+    //удалённые номера документов; удаление только снимает бит, списки слов чистит CompactIndex
+    std::vector<bool> is_live_ordinal_;
+    std::map<int, int> document_to_ordinal_;
     std::set<int> document_ids_;
-    std::map<int, std::map<std::string_view, double>> id_with_word_and_freqs_;
+    bool are_postings_compressed_ = false;
+    RankingFunction ranking_;
 
-    bool IsStopWord(const std::string_view word) const;
+    template <class ExecutionPolicy>
+    void AddDocumentsImpl(const ExecutionPolicy &policy, const std::vector<NewDocument> &documents);
+
+    template <class ExecutionPolicy>
+    void RemoveDocumentsImpl(const ExecutionPolicy &policy, const std::vector<int> &document_ids);
+
+    void InternStopWords();
+
+    TermId InternWord(const std::string_view word);
+
+    //записывает индекс в формате SaveIndex
+    void WriteIndex(std::ostream &output) const;
+
+    std::optional<TermId> FindTerm(const std::string_view word) const;
+
+    bool IsStopTerm(TermId term) const;
 
     static bool IsValidWord(const std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    std::vector<TermId> SplitIntoTermsNoStop(const std::string_view text);
 
     static int ComputeAverageRating(const std::vector<int> &ratings);
 
+    static std::vector<TermCount> CountTerms(std::vector<TermId> terms);
+
+    //длина документа - сумма чисел вхождений его слов
+    void InsertDocument(int document_id, std::string_view text, DocumentStatus status, int rating,
+                        const std::vector<TermCount> &term_counts);
+
+    TermCountRange GetTermCounts(const DocumentData &document_data) const;
+
+    //переносит хвост списка в сжатые блоки; неполный последний блок сжимается, только если is_last_block_sealed
+    void SealPostings(PostingList &posting_list, bool is_last_block_sealed) const;
+
+    bool HasTerm(const DocumentData &document_data, TermId term) const;
+
+    //когда удалена больше половины документов, убирает их из списков, а из словаря - слова
+    //без документов; номера документов и слов перенумеровываются с сохранением порядка
+    template <class ExecutionPolicy>
+    void CompactIndex(const ExecutionPolicy &policy);
+
+    //дописывает документы индекса с теми же стоп-словами, кроме excluded_ids, не разбирая текст заново
+    void AppendDocuments(const SearchServer &other, const std::set<int> &excluded_ids);
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
@@ -106,82 +306,263 @@ private:
 
     QueryWord ParseQueryWord(const std::string_view text) const;
 
+    //слова запроса, которых нет в словаре, ни с одним документом не совпадут и в запрос не попадают
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
     };
 
     Query ParseQuery(bool flag, const std::string_view text) const;
+    //words - буфер для слов текста, result заполняется заново
+    void ParseQuery(bool flag, const std::string_view text, std::vector<std::string_view> &words, Query &result) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    //вес слова по текущей функции ранжирования, кешируется до изменения индекса
+    double ComputeWordInverseDocumentFreq(TermId term) const;
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query &query,
-                                           DocumentPredicate document_predicate) const;
+    static bool IsMoreRelevant(const Document &lhs, const Document &rhs);
+
+    static void SelectTopDocuments(std::vector<Document> &documents, std::size_t top_k);
 
+    //policy - std::execution::par или QueryExecutor
+    template <class ExecutionPolicy>
+    static void SelectTopDocuments(const ExecutionPolicy &policy, std::vector<Document> &documents, std::size_t top_k);
+
+    //последовательная версия возвращает top_k лучших документов, параллельная делит документы
+    //на диапазоны номеров и из каждого возвращает не больше top_k лучших, поэтому результат
+    //остаётся выбрать из небольшого числа кандидатов.
+    //inverse_document_freq(term) - вес слова по ranking; составной индекс считает его по всем сегментам
+    //Рабочие массивы берутся из context, найденные документы записываются в documents
+    template <class ExecutionPolicy, typename DocumentPredicate, typename Ranking, typename InverseDocumentFreq>
+    void FindAllDocuments(const ExecutionPolicy &policy, const Query &query, DocumentPredicate document_predicate,
+                          const Ranking &ranking, const CollectionStats &stats, InverseDocumentFreq inverse_document_freq,
+                          std::size_t top_k, QueryContext &context, std::vector<Document> &documents) const;
+
+    //top_k лучших документов по разобранному запросу с текущей функцией ранжирования
     template <class ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const ExecutionPolicy &policy, const Query &query,
-                                                         DocumentPredicate document_predicate) const;
-};
+    void FindRankedDocuments(const ExecutionPolicy &policy, const Query &query, DocumentPredicate document_predicate,
+                             std::size_t top_k, QueryContext &context, std::vector<Document> &documents) const;
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
-                                    DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(true, raw_query);
+    struct WordPostings {
+        const PostingList* posting_list;
+        double inverse_document_freq;
+    };
+
+    //порядковые номера [first, last) для параллельного поиска
+    struct OrdinalRange {
+        int first;
+        int last;
+    };
+
+    std::vector<OrdinalRange> SplitOrdinals() const;
+
+    //курсор по списку документов слова в диапазоне номеров: сжатые блоки распаковываются по одному,
+    //затем курсор идёт по несжатому хвосту
+    class PostingCursor {
+    public:
+        PostingCursor(const SearchServer &search_server, const PostingList &posting_list, OrdinalRange range);
 
-    auto matched_documents = FindAllDocuments(query, document_predicate);
+        //номер документа под курсором или range.last, если документы диапазона кончились
+        int GetOrdinal() const {
+            return ordinal_;
+        }
+
+        //число вхождений слова в документ под курсором
+        std::uint32_t GetCount() const {
+            if (is_tail_) {
+                return posting_list_->postings[position_].count;
+            }
+            if (!are_counts_decoded_) {
+                posting_list_->blocks.DecodeCounts(block_, block_counts_);
+                are_counts_decoded_ = true;
+            }
+            return block_counts_[position_];
+        }
 
-    std::sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON()) {
-                return lhs.rating > rhs.rating;
+        void Next() {
+            ++position_;
+            if (position_ == size_ && !is_tail_) {
+                LoadBlock(block_ + 1);
+            }
+            Update();
+        }
+
+        //переходит к первому документу с номером не меньше ordinal
+        void Seek(int ordinal);
+
+    private:
+        const SearchServer* search_server_;
+        const PostingList* posting_list_;
+        int last_;
+        int ordinal_ = 0;
+        bool is_tail_ = false;
+        std::size_t block_ = 0;
+        std::size_t position_ = 0;
+        std::size_t size_ = 0;
+        int block_ordinals_[CompressedPostings::block_size_];
+        mutable std::uint32_t block_counts_[CompressedPostings::block_size_];
+        mutable bool are_counts_decoded_ = false;
+
+        void LoadBlock(std::size_t block);
+
+        void Update() {
+            if (position_ >= size_) {
+                ordinal_ = last_;
             } else {
-                return lhs.relevance > rhs.relevance;
+                ordinal_ = std::min(is_tail_ ? posting_list_->postings[position_].ordinal : block_ordinals_[position_], last_);
             }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
+        }
+    };
+
+    //отбирает top_k лучших документов диапазона, обходя списки слов одновременно по номеру документа
+    //(MaxScore). Документ не досчитывается, если даже с наибольшими вкладами оставшихся слов его
+    //релевантность ниже худшей из отобранных больше чем на EPSILON, а документы только со словами,
+    //чьи вклады в сумме не дотягивают до неё, не перебираются вовсе. Результат тот же, что при
+    //полном подсчёте
+    struct ScoredCursor {
+        PostingCursor postings;
+        double inverse_document_freq;
+        double max_relevance;//наибольший вклад слова в релевантность
+    };
+
+    template <typename DocumentPredicate, typename Ranking>
+    void FindDocumentsInRange(const std::vector<WordPostings> &plus_postings,
+                              const std::vector<WordPostings> &minus_postings,
+                              OrdinalRange range, DocumentPredicate document_predicate,
+                              const Ranking &ranking, const CollectionStats &stats,
+                              std::size_t top_k, QueryContext &context, std::vector<Document> &top_documents) const;
+};
+
+//Буферы, которые поиск заполняет заново при каждом запросе. Очистка вектора сохраняет его
+//ёмкость, поэтому после первых запросов память больше не выделяется. Один контекст нельзя
+//использовать из нескольких потоков одновременно
+class SearchServer::QueryContext {
+public:
+    QueryContext() = default;
+
+private:
+    friend class SearchServer;
+
+    std::vector<std::string_view> words_;
+    Query query_;
+    std::vector<WordPostings> plus_postings_;
+    std::vector<WordPostings> minus_postings_;
+    std::vector<ScoredCursor> cursors_;
+    std::vector<PostingCursor> minus_cursors_;
+    std::vector<std::size_t> order_;
+    std::vector<double> max_relevance_sums_;
+    std::vector<Document> documents_;
+    std::vector<TermId> terms_;
+    std::vector<std::string_view> matched_words_;
+};
+
+//Слова документа и их tf без копирования: обход идёт по прямому индексу сервера в порядке номеров
+//слов, tf считается при обращении. Прежний std::map<std::string_view, double> обходился по алфавиту,
+//этот порядок больше не гарантируется: номера слов идут в порядке внесения слов в словарь
+//сервера. Нужен алфавитный порядок - копируйте в std::map. Действителен, пока сервер не меняется;
+//слова, как и слова из MatchDocument, указывают в текст сервера, который уплотнение индекса при
+//удалении переносит
+class SearchServer::WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        value_type operator*() const {
+            return {search_server_->words_[it_->term], ComputeTermFreq(it_->count, length_)};
+        }
+
+        Iterator& operator++() {
+            ++it_;
+            return *this;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return it_ == other.it_;
+        }
+
+        bool operator!=(const Iterator &other) const {
+            return it_ != other.it_;
+        }
+
+    private:
+        friend class WordFrequencies;
+
+        Iterator(const SearchServer &search_server, std::vector<TermCount>::const_iterator it, std::uint32_t length)
+            : search_server_(&search_server)
+            , it_(it)
+            , length_(length) {
+        }
+
+        const SearchServer* search_server_;
+        std::vector<TermCount>::const_iterator it_;
+        std::uint32_t length_;
+    };
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    std::size_t size() const;
+
+    bool empty() const;
+
+    //1, если слово есть в документе, иначе 0
+    std::size_t count(const std::string_view word) const;
+
+    //tf слова; если его нет в документе, выбрасывает std::out_of_range
+    double at(const std::string_view word) const;
+
+private:
+    friend class SearchServer;
+
+    WordFrequencies(const SearchServer &search_server, TermCountRange term_counts, std::uint32_t length);
+
+    const SearchServer* search_server_;
+    TermCountRange term_counts_;
+    std::uint32_t length_;
+
+    //слово документа или term_counts_.end()
+    std::vector<TermCount>::const_iterator Find(const std::string_view word) const;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
+                                    DocumentPredicate document_predicate, std::size_t top_k) const {
+    QueryContext context;
+    FindTopDocuments(context, raw_query, document_predicate, top_k);
+    return std::move(context.documents_);
 }
 
 template <class ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query,
-                                    DocumentPredicate document_predicate) const {
+                                    DocumentPredicate document_predicate, std::size_t top_k) const {
     if (std::is_same_v<ExecutionPolicy, std::execution:: sequenced_policy>) {
-        return FindTopDocuments(raw_query, document_predicate);
+        return FindTopDocuments(raw_query, document_predicate, top_k);
     } else {
-        const auto query = ParseQuery(false, raw_query);
-
-        auto matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
-
-        std::sort(matched_documents.begin(), matched_documents.end(),
-            [](const Document& lhs, const Document& rhs) {
-                if (std::abs(lhs.relevance - rhs.relevance) < EPSILON()) {
-                    return lhs.rating > rhs.rating;
-                } else {
-                    return lhs.relevance > rhs.relevance;
-                }
-            });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-        return matched_documents;
+        QueryContext context;
+        ParseQuery(true, raw_query, context.words_, context.query_);
+        FindRankedDocuments(policy, context.query_, document_predicate, top_k, context, context.documents_);
+        return std::move(context.documents_);
     }
 }
 
 template <class ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status) const {
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const std::string_view raw_query, DocumentStatus status,
+                                                     std::size_t top_k) const {
     if (std::is_same_v<ExecutionPolicy, std::execution:: sequenced_policy>) {
         return FindTopDocuments(
         raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
             return document_status == status;
-        });
+        }, top_k);
     } else {
-        return FindTopDocuments(std::execution::par,
+        return FindTopDocuments(policy,
         raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
             return document_status == status;
-        });
+        }, top_k);
     }
 }
 
@@ -190,81 +571,220 @@ std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& poli
     if (std::is_same_v<ExecutionPolicy, std::execution:: sequenced_policy>) {
         return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
     } else {
-        return FindTopDocuments(std::execution::par, raw_query, DocumentStatus::ACTUAL);
+        return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
     }
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
-                                DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
-        }
+template <class ExecutionPolicy>
+void SearchServer::SelectTopDocuments(const ExecutionPolicy& policy, std::vector<Document>& documents, std::size_t top_k) {
+    const std::size_t part_count = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    const std::size_t part_size = (documents.size() + part_count - 1) / part_count;
+    if (part_size <= top_k) {
+        SelectTopDocuments(documents, top_k);
+        return;
     }
 
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+    std::vector<std::size_t> part_begins;
+    for (std::size_t begin = 0; begin < documents.size(); begin += part_size) {
+        part_begins.push_back(begin);
     }
-
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            {document_id, relevance, documents_.at(document_id).rating});
+    ParallelFor(policy, part_begins.size(), [&](std::size_t part) {
+        const auto first = documents.begin() + part_begins[part];
+        const auto last = documents.begin() + std::min(part_begins[part] + part_size, documents.size());
+        std::partial_sort(first, first + std::min<std::size_t>(top_k, last - first), last, IsMoreRelevant);
+    });
+
+    std::vector<Document> candidates;
+    candidates.reserve(part_begins.size() * top_k);
+    for (const std::size_t begin : part_begins) {
+        const auto first = documents.begin() + begin;
+        candidates.insert(candidates.end(), first, first + std::min(top_k, documents.size() - begin));
     }
-    return matched_documents;
+    SelectTopDocuments(candidates, top_k);
+    documents = std::move(candidates);
+}
+
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, const std::string_view raw_query,
+                                                            DocumentPredicate document_predicate, std::size_t top_k) const {
+    ParseQuery(true, raw_query, context.words_, context.query_);
+    FindRankedDocuments(std::execution::seq, context.query_, document_predicate, top_k, context, context.documents_);
+    return context.documents_;
 }
 
 template <class ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy& policy, const Query& query,
-                                DocumentPredicate document_predicate) const {
+void SearchServer::FindRankedDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate,
+                                       std::size_t top_k, QueryContext& context, std::vector<Document>& documents) const {
+    const CollectionStats stats = GetCollectionStats();
+    std::visit([&](const auto& ranking) {
+        FindAllDocuments(policy, query, document_predicate, ranking, stats, [this](TermId term) {
+            return ComputeWordInverseDocumentFreq(term);
+        }, top_k, context, documents);
+    }, ranking_);
+    if (!std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+        SelectTopDocuments(policy, documents, top_k);
+    }
+}
+
+template <class ExecutionPolicy, typename DocumentPredicate, typename Ranking, typename InverseDocumentFreq>
+void SearchServer::FindAllDocuments(const ExecutionPolicy& policy, const Query& query, DocumentPredicate document_predicate,
+                                    const Ranking& ranking, const CollectionStats& stats,
+                                    InverseDocumentFreq inverse_document_freq, std::size_t top_k,
+                                    QueryContext& context, std::vector<Document>& documents) const {
+    std::vector<WordPostings>& plus_postings = context.plus_postings_;
+    plus_postings.clear();
+    for (const TermId term : query.plus_terms) {
+        plus_postings.push_back({&word_to_document_freqs_[term], inverse_document_freq(term)});
+    }
+    std::vector<WordPostings>& minus_postings = context.minus_postings_;
+    minus_postings.clear();
+    for (const TermId term : query.minus_terms) {
+        minus_postings.push_back({&word_to_document_freqs_[term], 0.0});
+    }
+
     if (std::is_same_v<ExecutionPolicy, std::execution:: sequenced_policy>) {
-            return FindAllDocuments(query, document_predicate);
+        FindDocumentsInRange(plus_postings, minus_postings, {0, static_cast<int>(documents_.size())},
+                             document_predicate, ranking, stats, top_k, context, documents);
     } else {
-        std::map<int, double> document_to_relevance;
-        ConcurrentMap<int, double> map_document_to_relevance(5);
-
-        for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&, document_to_relevance](const std::string_view word) {
-            if (word_to_document_freqs_.count(word) > 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        map_document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
-            }
+        //каждый диапазон номеров обрабатывается целиком одним потоком со своим контекстом, поэтому блокировки не нужны
+        const std::vector<OrdinalRange> ranges = SplitOrdinals();
+        std::vector<std::vector<Document>> range_documents(ranges.size());
+        ParallelFor(policy, ranges.size(), [&](std::size_t i) {
+            QueryContext range_context;
+            FindDocumentsInRange(plus_postings, minus_postings, ranges[i], document_predicate,
+                                 ranking, stats, top_k, range_context, range_documents[i]);
         });
 
-        for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view word) {
-            if (word_to_document_freqs_.count(word) > 0) {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                    map_document_to_relevance.Erase(document_id);
-                }
-            }
-        });
+        documents.clear();
+        documents.reserve(ranges.size() * top_k);
+        for (const auto& range_top_documents : range_documents) {
+            documents.insert(documents.end(), range_top_documents.begin(), range_top_documents.end());
+        }
+    }
+}
 
-        document_to_relevance = map_document_to_relevance.BuildOrdinaryMap();
+template <typename DocumentPredicate, typename Ranking>
+void SearchServer::FindDocumentsInRange(const std::vector<WordPostings>& plus_postings,
+                                        const std::vector<WordPostings>& minus_postings,
+                                        OrdinalRange range, DocumentPredicate document_predicate,
+                                        const Ranking& ranking, const CollectionStats& stats,
+                                        std::size_t top_k, QueryContext& context, std::vector<Document>& top_documents) const {
+    //курсоры плюс-слов в порядке запроса: в этом порядке складывается релевантность
+    std::vector<ScoredCursor>& cursors = context.cursors_;
+    cursors.clear();
+    for (const auto [posting_list, inverse_document_freq] : plus_postings) {
+        cursors.push_back({PostingCursor(*this, *posting_list, range), inverse_document_freq,
+                           ranking.ComputeMaxRelevance(stats, posting_list->bounds, inverse_document_freq)});
+    }
+    std::vector<PostingCursor>& minus_cursors = context.minus_cursors_;
+    minus_cursors.clear();
+    for (const auto [posting_list, _] : minus_postings) {
+        minus_cursors.emplace_back(*this, *posting_list, range);
+    }
 
-        std::vector<Document> matched_documents(document_to_relevance.size);
-        transform(std::execution::par, document_to_relevance.begin(), document_to_relevance.end(), matched_documents.begin(), [&](const auto &pair_doc) {
-                Document doc(pair_doc.first, pair_doc.second, documents_.at(pair_doc.first).rating);
-                return doc; });
+    const auto compute_relevance = [this, &ranking, &stats](const ScoredCursor& cursor) {
+        return ranking.ComputeRelevance(stats, cursor.postings.GetCount(), document_lengths_[cursor.postings.GetOrdinal()],
+                                        cursor.inverse_document_freq);
+    };
 
-        return matched_documents;
+    //слова по возрастанию наибольшего вклада; order[0, essential_begin) - слова, которые
+    //вместе не дают документу попасть в результат, их списки только догоняют остальные
+    //при равных вкладах порядок запроса сохраняется; std::stable_sort выделял бы буфер
+    std::vector<std::size_t>& order = context.order_;
+    order.resize(cursors.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
     }
-}
+    std::sort(order.begin(), order.end(), [&cursors](std::size_t lhs, std::size_t rhs) {
+        return cursors[lhs].max_relevance < cursors[rhs].max_relevance
+            || (cursors[lhs].max_relevance == cursors[rhs].max_relevance && lhs < rhs);
+    });
+    std::vector<double>& max_relevance_sums = context.max_relevance_sums_;
+    max_relevance_sums.resize(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        max_relevance_sums[i] = (i > 0 ? max_relevance_sums[i - 1] : 0.0) + cursors[order[i]].max_relevance;
+    }
+    std::size_t essential_begin = 0;
+    //документ с релевантностью ниже threshold не попадёт в результат
+    double threshold = -std::numeric_limits<double>::infinity();
+
+    //куча отобранных документов, наверху худший
+    top_documents.clear();
+    top_documents.reserve(top_k);
+    while (top_k > 0) {
+        int ordinal = range.last;
+        for (std::size_t i = essential_begin; i < order.size(); ++i) {
+            ordinal = std::min(ordinal, cursors[order[i]].postings.GetOrdinal());
+        }
+        if (ordinal == range.last) {
+            break;
+        }
+
+        double max_relevance = essential_begin > 0 ? max_relevance_sums[essential_begin - 1] : 0.0;
+        for (std::size_t i = essential_begin; i < order.size(); ++i) {
+            const ScoredCursor& cursor = cursors[order[i]];
+            if (cursor.postings.GetOrdinal() == ordinal) {
+                max_relevance += compute_relevance(cursor);
+            }
+        }
+        //оценка уточняется по остальным словам начиная с самого весомого
+        for (std::size_t i = essential_begin; i > 0 && max_relevance >= threshold; --i) {
+            ScoredCursor& cursor = cursors[order[i - 1]];
+            cursor.postings.Seek(ordinal);
+            max_relevance -= cursor.max_relevance;
+            if (cursor.postings.GetOrdinal() == ordinal) {
+                max_relevance += compute_relevance(cursor);
+            }
+        }
 
+        bool is_matched = max_relevance >= threshold && is_live_ordinal_[ordinal];
+        for (PostingCursor& cursor : minus_cursors) {
+            if (!is_matched) {
+                break;
+            }
+            cursor.Seek(ordinal);
+            is_matched = cursor.GetOrdinal() != ordinal;
+        }
+        const auto& document_data = documents_[ordinal];
+        if (is_matched && document_predicate(document_data.id, document_data.status, document_data.rating)) {
+            double relevance = 0.0;
+            for (const ScoredCursor& cursor : cursors) {
+                if (cursor.postings.GetOrdinal() == ordinal) {
+                    relevance += compute_relevance(cursor);
+                }
+            }
+            const Document document{document_data.id, relevance, document_data.rating};
+            bool is_selected = true;
+            if (top_documents.size() < top_k) {
+                top_documents.push_back(document);
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            } else if (IsMoreRelevant(document, top_documents.front())) {
+                std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                top_documents.back() = document;
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            } else {
+                is_selected = false;
+            }
+            if (is_selected && top_documents.size() == top_k) {
+                //документ, который хуже каждого из отобранных больше чем на EPSILON, всем им проигрывает
+                double min_relevance = top_documents.front().relevance;
+                for (const Document& top_document : top_documents) {
+                    min_relevance = std::min(min_relevance, top_document.relevance);
+                }
+                threshold = min_relevance - 2 * EPSILON();
+                while (essential_begin < order.size() && max_relevance_sums[essential_begin] < threshold) {
+                    ++essential_begin;
+                }
+            }
+        }
+
+        for (std::size_t i = essential_begin; i < order.size(); ++i) {
+            ScoredCursor& cursor = cursors[order[i]];
+            if (cursor.postings.GetOrdinal() == ordinal) {
+                cursor.postings.Next();
+            }
+        }
+    }
+
+    std::sort(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+}
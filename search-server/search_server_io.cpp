@@ -0,0 +1,357 @@
+#include "search_server.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+//Формат файла (числа в порядке байтов машины, записавшей файл):
+//  заголовок: INDEX_MAGIC, версия uint32
+//  стоп-слова: строки
+//  словарь: строки (номер слова - позиция), число стоп-слов uint64
+//  документы: uint64 n; int32 id[n]; int32 rating[n]; int32 status[n]; тексты: строки;
+//             uint64 начало списка слов[n + 1]; пары (uint32 слово, uint32 число вхождений)[]
+//  списки документов: uint64 начало списка[слов + 1]; пары (int32 номер документа, uint32 число вхождений)[]
+//  строки: uint64 n; uint64 начало строки[n + 1]; символы
+const char INDEX_MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t INDEX_VERSION = 4;
+
+template <typename T>
+void Write(ostream& output, const T& value) {
+    output.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void WriteArray(ostream& output, const vector<T>& values) {
+    output.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename Strings>
+void WriteStrings(ostream& output, const Strings& strings) {
+    vector<uint64_t> offsets = {0};
+    for (const auto& str : strings) {
+        offsets.push_back(offsets.back() + str.size());
+    }
+    Write<uint64_t>(output, strings.size());
+    WriteArray(output, offsets);
+    for (const auto& str : strings) {
+        output.write(str.data(), str.size());
+    }
+}
+
+//хеш пары (слово, число вхождений) для сверки списков документов с прямым индексом
+uint64_t HashTermCount(uint32_t term, uint32_t count) {
+    uint64_t value = (static_cast<uint64_t>(term) << 32 | count) + 0x9e3779b97f4a7c15;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+void ThrowCorrupted() {
+    throw runtime_error("Index file is corrupted"s);
+}
+
+//массив в данных файла: значения читаются по одному, без копии всего массива
+template <typename T>
+class ArrayView {
+public:
+    ArrayView(const char* data, uint64_t size) : data_(data), size_(size) {
+    }
+
+    //данные файла не выровнены под T
+    T operator[](uint64_t index) const {
+        T value;
+        memcpy(&value, data_ + index * sizeof(T), sizeof(T));
+        return value;
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+
+    //копирует count значений, начиная с begin, одним блоком; у пустого вектора output может быть nullptr
+    void CopyTo(uint64_t begin, uint64_t count, T* output) const {
+        if (count > 0) {
+            memcpy(output, data_ + begin * sizeof(T), count * sizeof(T));
+        }
+    }
+
+private:
+    const char* data_;
+    uint64_t size_;
+};
+
+//читает файл по порядку, проверяя, что данные не выходят за его границы
+class IndexReader {
+public:
+    explicit IndexReader(string_view data) : data_(data) {
+    }
+
+    template <typename T>
+    T Read() {
+        T value;
+        memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    vector<T> ReadArray(uint64_t count) {
+        if (count > data_.size() / sizeof(T)) {
+            ThrowCorrupted();
+        }
+        vector<T> values(count);
+        memcpy(values.data(), Take(count * sizeof(T)), count * sizeof(T));
+        return values;
+    }
+
+    template <typename T>
+    ArrayView<T> ReadView(uint64_t count) {
+        if (count > data_.size() / sizeof(T)) {
+            ThrowCorrupted();
+        }
+        return ArrayView<T>(Take(count * sizeof(T)), count);
+    }
+
+    //count + 1 неубывающих начал частей, первое - 0; count берётся из файла и может быть любым
+    vector<uint64_t> ReadOffsets(uint64_t count) {
+        if (count >= data_.size() / sizeof(uint64_t)) {
+            ThrowCorrupted();
+        }
+        const auto offsets = ReadArray<uint64_t>(count + 1);
+        if (offsets.front() != 0 || !is_sorted(offsets.begin(), offsets.end())) {
+            ThrowCorrupted();
+        }
+        return offsets;
+    }
+
+    //строки указывают прямо в данные файла
+    vector<string_view> ReadStrings() {
+        const auto offsets = ReadOffsets(Read<uint64_t>());
+        const char* chars = Take(offsets.back());
+        vector<string_view> strings;
+        strings.reserve(offsets.size() - 1);
+        for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+            strings.emplace_back(chars + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+        return strings;
+    }
+
+private:
+    const char* Take(uint64_t size) {
+        if (size > data_.size() - position_) {
+            ThrowCorrupted();
+        }
+        const char* result = data_.data() + position_;
+        position_ += size;
+        return result;
+    }
+
+    string_view data_;
+    size_t position_ = 0;
+};
+
+} // namespace
+
+//Индекс пишется во временный файл, который затем заменяет path. Сервер, загруженный из path,
+//продолжает читать прежний файл через отображение: его данные не меняются при замене
+void SearchServer::SaveIndex(const string& path) const {
+    const string temp_path = path + ".tmp"s;
+    try {
+        {
+            ofstream output(temp_path, ios::binary);
+            if (!output) {
+                throw runtime_error("Cannot create file "s + temp_path);
+            }
+            WriteIndex(output);
+            output.close();
+            if (!output) {
+                throw runtime_error("Cannot write file "s + temp_path);
+            }
+        }
+        if (rename(temp_path.c_str(), path.c_str()) != 0) {
+            throw runtime_error("Cannot replace file "s + path);
+        }
+    } catch (...) {
+        remove(temp_path.c_str());
+        throw;
+    }
+}
+
+void SearchServer::WriteIndex(ostream& output) const {
+    //удалённые документы не сохраняем, номера оставшихся идут подряд
+    vector<int> new_ordinals(documents_.size(), -1);
+    vector<int> ordinals;
+    for (const auto [document_id, ordinal] : document_to_ordinal_) {
+        ordinals.push_back(ordinal);
+    }
+    sort(ordinals.begin(), ordinals.end());
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        new_ordinals[ordinals[i]] = static_cast<int>(i);
+    }
+
+    output.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    Write(output, INDEX_VERSION);
+
+    WriteStrings(output, stop_words_);
+    WriteStrings(output, words_);
+    Write<uint64_t>(output, stop_term_count_);
+
+    vector<int32_t> ids, ratings, statuses;
+    vector<string_view> texts;
+    vector<uint64_t> term_offsets = {0};
+    vector<TermCount> term_counts;
+    for (const int ordinal : ordinals) {
+        const DocumentData& document_data = documents_[ordinal];
+        ids.push_back(document_data.id);
+        ratings.push_back(document_data.rating);
+        statuses.push_back(static_cast<int32_t>(document_data.status));
+        texts.push_back(document_data.text);
+        const auto document_term_counts = GetTermCounts(document_data);
+        term_counts.insert(term_counts.end(), document_term_counts.begin(), document_term_counts.end());
+        term_offsets.push_back(term_counts.size());
+    }
+    Write<uint64_t>(output, ids.size());
+    WriteArray(output, ids);
+    WriteArray(output, ratings);
+    WriteArray(output, statuses);
+    WriteStrings(output, texts);
+    WriteArray(output, term_offsets);
+    WriteArray(output, term_counts);
+
+    vector<uint64_t> posting_offsets = {0};
+    vector<Posting> postings;
+    for (const PostingList& posting_list : word_to_document_freqs_) {
+        for (PostingCursor cursor(*this, posting_list, {0, static_cast<int>(documents_.size())});
+             cursor.GetOrdinal() < static_cast<int>(documents_.size()); cursor.Next()) {
+            if (new_ordinals[cursor.GetOrdinal()] < 0) {
+                continue;
+            }
+            postings.push_back({new_ordinals[cursor.GetOrdinal()], cursor.GetCount()});
+        }
+        posting_offsets.push_back(postings.size());
+    }
+    WriteArray(output, posting_offsets);
+    WriteArray(output, postings);
+}
+
+SearchServer SearchServer::LoadIndex(const string& path) {
+    const auto file = make_shared<MappedFile>(path);
+    IndexReader reader(file->GetData());
+
+    char magic[sizeof(INDEX_MAGIC)];
+    for (char& c : magic) {
+        c = reader.Read<char>();
+    }
+    if (memcmp(magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        throw runtime_error("Not an index file: "s + path);
+    }
+    const auto version = reader.Read<uint32_t>();
+    if (version != INDEX_VERSION) {
+        throw runtime_error("Unsupported index version "s + to_string(version));
+    }
+
+    SearchServer search_server(reader.ReadStrings());
+
+    //словарь начинается стоп-словами сервера в том же порядке, слова не повторяются
+    const vector<string_view> words = reader.ReadStrings();
+    if (reader.Read<uint64_t>() != search_server.stop_term_count_ || words.size() < search_server.stop_term_count_
+        || !equal(words.begin(), words.begin() + search_server.stop_term_count_, search_server.words_.begin())) {
+        ThrowCorrupted();
+    }
+    search_server.word_to_term_.reserve(words.size());
+    search_server.word_to_document_freqs_.reserve(words.size());
+    for (size_t term = search_server.stop_term_count_; term < words.size(); ++term) {
+        search_server.words_.push_back(search_server.texts_.Adopt(words[term], file));
+        if (!search_server.word_to_term_.emplace(words[term], static_cast<TermId>(term)).second) {
+            ThrowCorrupted();
+        }
+        search_server.word_to_document_freqs_.emplace_back();
+    }
+
+    //пары в файле лежат так же, как TermCount и Posting в памяти, и копируются блоками
+    static_assert(sizeof(TermCount) == 2 * sizeof(uint32_t) && sizeof(Posting) == 2 * sizeof(uint32_t));
+    const auto document_count = reader.Read<uint64_t>();
+    const auto ids = reader.ReadView<int32_t>(document_count);
+    const auto ratings = reader.ReadView<int32_t>(document_count);
+    const auto statuses = reader.ReadView<int32_t>(document_count);
+    const auto texts = reader.ReadStrings();
+    const auto term_offsets = reader.ReadOffsets(document_count);
+    const auto term_counts = reader.ReadView<TermCount>(term_offsets.back());
+    if (texts.size() != document_count) {
+        ThrowCorrupted();
+    }
+
+    //слова документа строго возрастают и не бывают стоп-словами
+    search_server.term_counts_.resize(term_counts.size());
+    term_counts.CopyTo(0, term_counts.size(), search_server.term_counts_.data());
+    vector<pair<int, int>> id_ordinals;
+    id_ordinals.reserve(document_count);
+    vector<uint64_t> term_count_hashes(document_count, 0);
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        const int32_t status = statuses[ordinal];
+        if (ids[ordinal] < 0 || status < static_cast<int32_t>(DocumentStatus::ACTUAL)
+            || status > static_cast<int32_t>(DocumentStatus::REMOVED)) {
+            ThrowCorrupted();
+        }
+        uint32_t length = 0;
+        for (uint64_t i = term_offsets[ordinal]; i < term_offsets[ordinal + 1]; ++i) {
+            const TermCount& term_count = search_server.term_counts_[i];
+            if (term_count.term < search_server.stop_term_count_ || term_count.term >= words.size() || term_count.count == 0
+                || (i > term_offsets[ordinal] && term_count.term <= search_server.term_counts_[i - 1].term)) {
+                ThrowCorrupted();
+            }
+            length += term_count.count;
+            term_count_hashes[ordinal] += HashTermCount(term_count.term, term_count.count);
+        }
+        search_server.documents_.push_back(DocumentData{ids[ordinal], ratings[ordinal], static_cast<DocumentStatus>(status),
+                                                        search_server.texts_.Adopt(texts[ordinal], file),
+                                                        term_offsets[ordinal], term_offsets[ordinal + 1]});
+        search_server.document_lengths_.push_back(length);
+        search_server.total_document_length_ += length;
+        id_ordinals.push_back({ids[ordinal], static_cast<int>(ordinal)});
+    }
+    search_server.is_live_ordinal_.assign(document_count, true);
+
+    //id уникальны; отсортированные id вставляются в конец деревьев без поиска места
+    sort(id_ordinals.begin(), id_ordinals.end());
+    for (size_t i = 0; i < id_ordinals.size(); ++i) {
+        if (i > 0 && id_ordinals[i].first == id_ordinals[i - 1].first) {
+            ThrowCorrupted();
+        }
+        search_server.document_to_ordinal_.emplace_hint(search_server.document_to_ordinal_.end(), id_ordinals[i]);
+        search_server.document_ids_.emplace_hint(search_server.document_ids_.end(), id_ordinals[i].first);
+    }
+
+    //Списки документов копируются блоками, номера в списке строго возрастают. Пары документа
+    //в прямом индексе и пары, собранные по спискам, сверяются суммами хешей: у каждого документа
+    //в обоих местах должны быть одни и те же пары. Сверка не обращается к прямому индексу
+    //вразброс, ложное совпадение возможно с вероятностью порядка 2^-64
+    const auto posting_offsets = reader.ReadOffsets(words.size());
+    const auto postings = reader.ReadView<Posting>(posting_offsets.back());
+    for (size_t term = 0; term < words.size(); ++term) {
+        PostingList& posting_list = search_server.word_to_document_freqs_[term];
+        posting_list.postings.resize(posting_offsets[term + 1] - posting_offsets[term]);
+        postings.CopyTo(posting_offsets[term], posting_list.postings.size(), posting_list.postings.data());
+        for (size_t i = 0; i < posting_list.postings.size(); ++i) {
+            const auto [ordinal, count] = posting_list.postings[i];
+            if (ordinal < 0 || static_cast<uint64_t>(ordinal) >= document_count
+                || (i > 0 && ordinal <= posting_list.postings[i - 1].ordinal)) {
+                ThrowCorrupted();
+            }
+            term_count_hashes[ordinal] -= HashTermCount(static_cast<uint32_t>(term), count);
+            posting_list.bounds.Add(count, search_server.document_lengths_[ordinal]);
+        }
+        posting_list.live_count = static_cast<int>(posting_list.postings.size());
+    }
+    if (any_of(term_count_hashes.begin(), term_count_hashes.end(), [](uint64_t hash) { return hash != 0; })) {
+        ThrowCorrupted();
+    }
+
+    return search_server;
+}
@@ -1,7 +1,13 @@
 #include "string_processing.h"
 
+#include <cstdint>
 #include <iostream>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SEARCH_SERVER_HAS_SIMD
+#endif
+
 using namespace std;
 
 vector<string> SplitIntoWords(const string& text) {
@@ -23,18 +29,131 @@ vector<string> SplitIntoWords(const string& text) {
     return words;
 }
 
+namespace {
+
+//состояние разбора между блоками текста
+struct WordSplitter {
+    string_view text;
+    vector<string_view>& words;
+    size_t word_begin = 0;
+    bool is_after_space = true;//перед началом текста как будто стоит пробел
+    bool has_control = false;
+
+    //space_mask: бит i - пробел в позиции offset + i, block_size - число байт в блоке
+    void AddBlock(size_t offset, uint64_t space_mask, size_t block_size) {
+        const uint64_t block_mask = (uint64_t{1} << block_size) - 1;
+        const uint64_t after_space_mask = ((space_mask << 1) | (is_after_space ? 1 : 0)) & block_mask;
+        //начала слов и позиции пробелов сразу за словами идут по очереди
+        uint64_t bounds = (~space_mask & after_space_mask) | (space_mask & ~after_space_mask & block_mask);
+        while (bounds != 0) {
+            const size_t position = offset + __builtin_ctzll(bounds);
+            if (is_after_space) {
+                word_begin = position;
+            } else {
+                words.push_back(text.substr(word_begin, position - word_begin));
+            }
+            is_after_space = !is_after_space;
+            bounds &= bounds - 1;
+        }
+    }
+
+    void AddScalar(size_t offset) {
+        for (size_t i = offset; i < text.size(); ++i) {
+            const unsigned char c = static_cast<unsigned char>(text[i]);
+            has_control |= c < ' ';
+            if ((c == ' ') != is_after_space) {
+                if (is_after_space) {
+                    word_begin = i;
+                } else {
+                    words.push_back(text.substr(word_begin, i - word_begin));
+                }
+                is_after_space = !is_after_space;
+            }
+        }
+    }
+
+    void Finish() {
+        if (!is_after_space) {
+            words.push_back(text.substr(word_begin));
+        }
+    }
+};
+
+#ifdef SEARCH_SERVER_HAS_SIMD
+//байт не больше пробела - пробел или управляющий символ; сравнение беззнаковое через min
+void SplitSse2(WordSplitter& splitter) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    size_t offset = 0;
+    for (; offset + 16 <= splitter.text.size(); offset += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(splitter.text.data() + offset));
+        const uint32_t space_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces));
+        const uint32_t separator_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(block, spaces), block));
+        splitter.has_control |= separator_mask != space_mask;
+        splitter.AddBlock(offset, space_mask, 16);
+    }
+    splitter.AddScalar(offset);
+}
+
+__attribute__((target("avx2")))
+void SplitAvx2(WordSplitter& splitter) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    size_t offset = 0;
+    for (; offset + 32 <= splitter.text.size(); offset += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(splitter.text.data() + offset));
+        const uint32_t space_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, spaces));
+        const uint32_t separator_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(block, spaces), block));
+        splitter.has_control |= separator_mask != space_mask;
+        splitter.AddBlock(offset, space_mask, 32);
+    }
+    splitter.AddScalar(offset);
+}
+#else
+void SplitScalar(WordSplitter& splitter) {
+    splitter.AddScalar(0);
+}
+#endif
+
+using SplitFunction = void (*)(WordSplitter&);
+
+SplitFunction SelectSplitFunction() {
+#ifdef SEARCH_SERVER_HAS_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return SplitAvx2;
+    }
+    return SplitSse2;
+#else
+    return SplitScalar;
+#endif
+}
+
+//дописывает слова в words; false, если в тексте есть управляющие символы
+bool Split(const string_view text, vector<string_view>& words) {
+    static const SplitFunction split = SelectSplitFunction();
+    WordSplitter splitter{text, words};
+    //слово со своим пробелом обычно длиннее 6 байт, так что переаллокаций почти не бывает
+    words.reserve(words.size() + text.size() / 6);
+    split(splitter);
+    splitter.Finish();
+    return !splitter.has_control;
+}
+
+}  // namespace
+
 vector<string_view> SplitIntoWordsView(const string_view text) {
-    string_view str{text};
-    vector<string_view> result;
-    str.remove_prefix(min(str.find_first_not_of(" "), str.size()));
-    int64_t pos = str.find_first_not_of(" ");
-    const int64_t pos_end = str.npos;
-    
-    while (pos != pos_end) {
-        int64_t space = str.find(' ', pos);
-        result.push_back(space == pos_end ? str.substr(pos) : str.substr(pos, space - pos));
-        pos = str.find_first_not_of(" ", space);
-    }
-
-    return result;
-}
\ No newline at end of file
+    vector<string_view> words;
+    Split(text, words);
+    return words;
+}
+
+void SplitIntoWordsView(const string_view text, vector<string_view>& words) {
+    words.clear();
+    Split(text, words);
+}
+
+optional<vector<string_view>> SplitIntoValidWordsView(const string_view text) {
+    vector<string_view> words;
+    if (!Split(text, words)) {
+        return nullopt;
+    }
+    return words;
+}
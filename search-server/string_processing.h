@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <optional>
 #include <set>
 #include <string_view>
 
@@ -10,6 +11,14 @@ std::vector<std::string> SplitIntoWords(const std::string &text);
 
 std::vector<std::string_view> SplitIntoWordsView(const std::string_view text);
 
+//то же в уже выделенный вектор: если его ёмкости хватает, память не выделяется
+void SplitIntoWordsView(const std::string_view text, std::vector<std::string_view> &words);
+
+//разбивает текст на слова и за тот же проход проверяет, что в нём нет управляющих символов
+//(коды 0-31); если они есть, возвращает nullopt. Текст разбирается блоками по 32 или 16 байт
+//командами AVX2 или SSE2, набор команд выбирается при запуске по процессору
+std::optional<std::vector<std::string_view>> SplitIntoValidWordsView(const std::string_view text);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
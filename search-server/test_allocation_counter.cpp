@@ -0,0 +1,34 @@
+#include "test_allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+//Замена глобальных operator new и operator delete, которая считает выделения.
+//Замена живёт в отдельном файле, чтобы компилятор не встраивал её в вызывающий код
+namespace {
+
+thread_local size_t allocation_count = 0;
+
+} // namespace
+
+size_t GetAllocationCount() {
+    return allocation_count;
+}
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    if (void* ptr = malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+//Счётчик для тестов: test_allocation_counter.cpp заменяет глобальные operator new и operator delete
+
+//число выделений памяти через operator new в текущем потоке с начала его работы
+std::size_t GetAllocationCount();
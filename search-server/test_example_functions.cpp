@@ -35,6 +35,11 @@ void BeginEndSizeTest() {
     assert(search_server.size() == 5);
 }
 
+map<string_view, double> CollectWordFrequencies(const SearchServer& search_server, int document_id) {
+    const auto word_frequencies = search_server.GetWordFrequencies(document_id);
+    return {word_frequencies.begin(), word_frequencies.end()};
+}
+
 void TestGetWordFrequencies() {
     SearchServer search_server("and in at"s);
     search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
@@ -45,13 +50,38 @@ void TestGetWordFrequencies() {
     map<string_view, double> test;
     {
     LOG_DURATION_STREAM("Operation GetWordFrequencies time", cout);
-    test = search_server.GetWordFrequencies(2);
+    test = CollectWordFrequencies(search_server, 2);
     }
     const auto it = next(test.begin(), 1);
 
     assert(test.size() == 4);
     assert(it->first == "curly"s);
     assert(it->second == 0.25);
+
+    //представление обходит слова документа в порядке их номеров, не копируя их: "curly" попало
+    //в словарь раньше "collar", поэтому идёт первым, хотя по алфавиту оно второе
+    const auto word_frequencies = search_server.GetWordFrequencies(2);
+    assert(word_frequencies.size() == 4);
+    assert((*word_frequencies.begin() == pair{"curly"sv, 0.25}));
+    assert(word_frequencies.count("collar"sv) == 1 && word_frequencies.at("collar"sv) == 0.25);
+    assert(word_frequencies.count("and"sv) == 0 && word_frequencies.count("parrot"sv) == 0);
+    try {
+        word_frequencies.at("cat"sv);
+        assert(false);
+    } catch (const out_of_range&) {
+    }
+    assert(search_server.GetWordFrequencies(42).empty());
+
+    //удаление документов уплотняет прямой индекс, слова остальных документов не меняются.
+    //Текст слов при этом переносится, поэтому ожидаемые слова копируются
+    const map<string, double> expected(test.begin(), test.end());
+    search_server.RemoveDocument(1);
+    search_server.RemoveDocuments({3, 4});
+    const auto frequencies = CollectWordFrequencies(search_server, 2);
+    assert((map<string, double>(frequencies.begin(), frequencies.end()) == expected));
+    assert(search_server.GetWordFrequencies(1).empty());
+    const auto [words, status] = search_server.MatchDocument("sparrow dog -cat"s, 5);
+    assert((words == vector{"dog"sv, "sparrow"sv}));
 }
 
 void RemoveDocument(SearchServer& search_server, int document_id) {
@@ -78,6 +108,123 @@ void TestRemoveDocument() {
     assert(*it == 3);
 }
 
+void TestRemoveDocumentCompaction() {
+    //удаление половины и больше документов уплотняет индекс; результаты не меняются
+    SearchServer search_server("and in at"s);
+    for (int id = 0; id < 100; ++id) {
+        search_server.AddDocument(id, "cat dog word"s + to_string(id), DocumentStatus::ACTUAL, {id});
+    }
+    for (int id = 0; id < 100; ++id) {
+        if (id % 3 != 0) {
+            if (id % 2 == 0) {
+                search_server.RemoveDocument(execution::par, id);
+            } else {
+                search_server.RemoveDocument(id);
+            }
+        }
+        for (const int checked_id : {0, 99}) {
+            assert(search_server.GetWordFrequencies(checked_id).count("word"s + to_string(checked_id)) == 1);
+        }
+    }
+    assert(search_server.GetDocumentCount() == 34);
+    const auto documents = search_server.FindTopDocuments("word3 word4 dog"s);
+    assert(documents.size() == 5);
+    assert(documents[0].id == 3);
+    assert(search_server.FindTopDocuments("word4"s).empty());
+    assert(search_server.FindTopDocuments(execution::par, "dog -word99"s, DocumentStatus::ACTUAL, 100).size() == 33);
+
+    //все документы удалены, а затем добавлены снова
+    for (int id = 0; id < 100; id += 3) {
+        search_server.RemoveDocument(id);
+    }
+    assert(search_server.FindTopDocuments("dog"s).empty());
+    search_server.AddDocument(4, "big dog"s, DocumentStatus::ACTUAL, {1});
+    assert(search_server.FindTopDocuments("dog"s)[0].relevance == 0.0);
+
+    //уплотнение освобождает текст удалённых документов и их слов
+    SearchServer long_texts("and in at"s);
+    for (int id = 0; id < 100; ++id) {
+        string text;
+        for (int word = 0; word < 2'000; ++word) {
+            text += "w"s + to_string(id * 2'000 + word) + " "s;
+        }
+        long_texts.AddDocument(id, text, DocumentStatus::ACTUAL, {id});
+    }
+    const size_t text_memory_usage = long_texts.GetTextMemoryUsage();
+    for (int id = 0; id < 90; ++id) {
+        long_texts.RemoveDocument(id);
+    }
+    assert(long_texts.GetTextMemoryUsage() * 2 < text_memory_usage);
+    assert(long_texts.GetWordFrequencies(95).count("w190000"s) == 1);
+    assert(long_texts.FindTopDocuments("w199999 w0"s)[0].id == 99);
+    const auto [words, status] = long_texts.MatchDocument("w190001 w5"s, 95);
+    assert(words.size() == 1 && words[0] == "w190001"s);
+
+    //текст отображённого файла уплотнение не копирует, слова из него остаются действительными
+    const string path = "test_compaction_index.bin"s;
+    {
+        SearchServer saved("and in at"s);
+        for (int id = 0; id < 100; ++id) {
+            saved.AddDocument(id, "cat dog word"s + to_string(id), DocumentStatus::ACTUAL, {id});
+        }
+        saved.SaveIndex(path);
+        SearchServer loaded = SearchServer::LoadIndex(path);
+        const size_t loaded_memory_usage = loaded.GetTextMemoryUsage();
+        const auto [loaded_words, loaded_status] = loaded.MatchDocument("word99 cat"s, 99);
+        for (int id = 0; id < 90; ++id) {
+            loaded.RemoveDocument(id);
+        }
+        assert(loaded.GetTextMemoryUsage() == loaded_memory_usage);
+        assert((loaded_words == vector{"cat"sv, "word99"sv}));
+        assert(get<0>(loaded.MatchDocument("word99 cat"s, 99)) == loaded_words);
+    }
+    remove(path.c_str());
+}
+
+void TestRemoveDocuments() {
+    //документы с тысячами разных слов: пакетное параллельное удаление против удаления по одному
+    vector<string> texts;
+    for (int id = 0; id < 40; ++id) {
+        string text;
+        for (int word = 0; word < 3'000; ++word) {
+            text += "w"s + to_string((id * 131 + word * 7) % 5'000) + " "s;
+        }
+        texts.push_back(text);
+    }
+    SearchServer one_by_one("and in at"s);
+    SearchServer batch("and in at"s);
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        one_by_one.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+        batch.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id});
+    }
+    vector<int> removed_ids;
+    for (int id = 0; id < static_cast<int>(texts.size()); id += 3) {
+        one_by_one.RemoveDocument(execution::par, id);
+        removed_ids.push_back(id);
+    }
+    batch.RemoveDocuments(execution::par, removed_ids);
+
+    assert(batch.GetDocumentCount() == one_by_one.GetDocumentCount());
+    for (const string& query : {"w1 w2 w3"s, "w17 -w4000"s, "w4999 w0"s}) {
+        const auto expected = one_by_one.FindTopDocuments(query, DocumentStatus::ACTUAL, 40);
+        const auto actual = batch.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 40);
+        assert(actual.size() == expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            assert(actual[i].id == expected[i].id);
+            assert(actual[i].relevance == expected[i].relevance);
+        }
+    }
+
+    //ошибочный id: в исключении его id, ничего не удалено
+    try {
+        batch.RemoveDocuments({1, 2, 3});
+        assert(false);
+    } catch (const invalid_argument& e) {
+        assert(string(e.what()).find("3"s) != string::npos);
+    }
+    assert(batch.GetDocumentCount() == one_by_one.GetDocumentCount());
+}
+
 void TestRemoveDuplicates() {
     SearchServer search_server("and with"s);
 
@@ -90,10 +237,13 @@ void TestRemoveDuplicates() {
     AddDocument(search_server, 7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
     AddDocument(search_server, 8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
     AddDocument(search_server, 9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    vector<DuplicateDocument> duplicates;
     {
     LOG_DURATION_STREAM("Operation RemoveDuplicates time", cout);
-    RemoveDuplicates(search_server);
+    duplicates = RemoveDuplicates(search_server);
     }
+    assert(duplicates.size() == 4 && duplicates[0].document_id == 3 && duplicates[0].original_id == 2);
+    assert(duplicates[3].document_id == 7 && duplicates[3].original_id == 6);
     set<int> test1 = {1, 2, 6, 8, 9};
     set<int> test2;
     auto it = search_server.begin();
@@ -105,11 +255,1047 @@ void TestRemoveDuplicates() {
     assert(test1 == test2);
 }
 
+void TestFindTopDocumentsTopK() {
+    SearchServer search_server("and in at"s);
+    for (int id = 1; id <= 20; ++id) {
+        search_server.AddDocument(id, "curly cat "s + string(id, 'x'), DocumentStatus::ACTUAL, {id % 4});
+    }
+    const auto top_three = search_server.FindTopDocuments("curly cat"s, DocumentStatus::ACTUAL, 3);
+    const auto top_all = search_server.FindTopDocuments("curly cat"s, DocumentStatus::ACTUAL, 100);
+    const auto top_par = search_server.FindTopDocuments(execution::par, "curly cat"s, DocumentStatus::ACTUAL, 3);
+
+    assert(top_three.size() == 3);
+    assert(top_all.size() == 20);
+    assert(search_server.FindTopDocuments("curly cat"s).size() == MAX_RESULT_DOCUMENT_COUNT);
+    for (size_t i = 0; i < top_three.size(); ++i) {
+        assert(top_three[i].id == top_all[i].id);
+        assert(top_par[i].id == top_all[i].id);
+    }
+    //равная релевантность - выше рейтинг
+    assert(top_all[0].rating == 3);
+}
+
+void TestFindTopDocumentsShards() {
+    //документов больше, чем в одном диапазоне номеров, поэтому top_k выбирается в каждом диапазоне
+    SearchServer search_server("and in at"s);
+    for (int id = 0; id < 20'000; ++id) {
+        search_server.AddDocument(id, "cat word"s + to_string(id % 31) + " tail"s + to_string(id % 17), DocumentStatus::ACTUAL, {id % 11});
+    }
+    const auto is_even = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    for (const string& query : {"cat tail3"s, "word4 tail4 -word5"s, "cat -tail1"s}) {
+        const auto expected = search_server.FindTopDocuments(query, is_even, 50);
+        const auto actual = search_server.FindTopDocuments(execution::par, query, is_even, 50);
+        assert(expected.size() == 50);
+        assert(actual.size() == expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            assert(actual[i].id == expected[i].id);
+            assert(actual[i].relevance == expected[i].relevance);
+            assert(actual[i].id % 2 == 0);
+        }
+    }
+}
+
+void TestFindTopDocumentsPruning() {
+    //длина документов и частота слов разные, поэтому верхние границы вкладов слов различаются
+    SearchServer search_server("and in at"s);
+    for (int id = 0; id < 3'000; ++id) {
+        string document;
+        for (int k = 0; k <= id % 9; ++k) {
+            document += " w"s + to_string((id * 31 + k * k * 17) % (5 + k * 6));
+        }
+        search_server.AddDocument(id, document, DocumentStatus::ACTUAL, {id % 5});
+    }
+    for (int id = 0; id < 3'000; id += 7) {
+        search_server.RemoveDocument(id);
+    }
+
+    //полный подсчёт: слагаемые складываются в порядке текста слов, как в сервере
+    map<string_view, int> word_document_counts;
+    for (const int id : search_server) {
+        for (const auto& [word, _] : search_server.GetWordFrequencies(id)) {
+            ++word_document_counts[word];
+        }
+    }
+    const auto find_expected = [&](const set<string>& plus_words, const set<string>& minus_words, size_t top_k) {
+        vector<Document> documents;
+        for (const int id : search_server) {
+            const auto word_frequencies = CollectWordFrequencies(search_server, id);
+            const bool has_minus_word = any_of(minus_words.begin(), minus_words.end(), [&](const string& word) {
+                return word_frequencies.count(word) > 0;
+            });
+            if (has_minus_word || id % 5 == 2) {
+                continue;
+            }
+            double relevance = 0.0;
+            bool is_matched = false;
+            for (const string& word : plus_words) {
+                const auto it = word_frequencies.find(word);
+                if (it != word_frequencies.end()) {
+                    relevance += it->second * log(search_server.GetDocumentCount() * 1.0 / word_document_counts.at(it->first));
+                    is_matched = true;
+                }
+            }
+            if (is_matched) {
+                documents.push_back({id, relevance, id % 5});
+            }
+        }
+        sort(documents.begin(), documents.end(), [](const Document& lhs, const Document& rhs) {
+            if (abs(lhs.relevance - rhs.relevance) < EPSILON()) {
+                return lhs.rating == rhs.rating ? lhs.id < rhs.id : lhs.rating > rhs.rating;
+            }
+            return lhs.relevance > rhs.relevance;
+        });
+        documents.resize(min(documents.size(), top_k));
+        return documents;
+    };
+
+    const auto is_matched = [](int, DocumentStatus, int rating) {
+        return rating != 2;
+    };
+    const vector<pair<set<string>, set<string>>> queries = {
+        {{"w0"s}, {}}, {{"w1"s, "w3"s}, {}}, {{"w0"s, "w2"s, "w17"s, "w30"s}, {"w4"s}},
+        {{"w1"s, "w5"s, "w9"s, "w11"s, "w23"s, "w40"s}, {"w0"s, "w7"s}}, {{"w52"s, "w3"s}, {"w2"s}}};
+    for (const auto& [plus_words, minus_words] : queries) {
+        string query;
+        for (const string& word : plus_words) {
+            query += word + " "s;
+        }
+        for (const string& word : minus_words) {
+            query += "-"s + word + " "s;
+        }
+        for (const size_t top_k : {1, 5, 50}) {
+            const auto expected = find_expected(plus_words, minus_words, top_k);
+            for (const auto& actual : {search_server.FindTopDocuments(query, is_matched, top_k),
+                                       search_server.FindTopDocuments(execution::par, query, is_matched, top_k)}) {
+                assert(actual.size() == expected.size());
+                for (size_t i = 0; i < actual.size(); ++i) {
+                    assert(actual[i].id == expected[i].id);
+                    assert(actual[i].relevance == expected[i].relevance);
+                }
+            }
+        }
+    }
+}
+
+void TestAddDocumentWithStorage() {
+    SearchServer search_server("and in at"s);
+    {
+        auto corpus = make_shared<string>("curly cat curly tail\nbig dog and fancy collar"s);
+        const string_view text(*corpus);
+        const size_t line_end = text.find('\n');
+        search_server.AddDocument(1, text.substr(0, line_end), DocumentStatus::ACTUAL, {1, 2, 3}, corpus);
+        search_server.AddDocument(2, text.substr(line_end + 1), DocumentStatus::ACTUAL, {1, 2, 3}, corpus);
+    }
+    const auto documents = search_server.FindTopDocuments("curly collar"s);
+    assert(documents.size() == 2);
+    assert(documents[0].id == 1);
+
+    const auto [words, status] = search_server.MatchDocument("fancy dog -cat"s, 2);
+    assert(words.size() == 2);
+    assert(words[0] == "dog"s);
+}
+
+void TestAddDocuments() {
+    const vector<string> texts = {"curly cat curly tail"s, "curly dog and fancy collar"s, "big cat fancy collar "s};
+    SearchServer one_by_one("and in at"s);
+    SearchServer batch("and in at"s);
+    vector<NewDocument> documents;
+    for (int id = 0; id < static_cast<int>(texts.size()); ++id) {
+        one_by_one.AddDocument(id, texts[id], DocumentStatus::ACTUAL, {id, 2});
+        documents.push_back({id, texts[id], DocumentStatus::ACTUAL, {id, 2}});
+    }
+    batch.AddDocuments(execution::par, documents);
+
+    const auto expected = one_by_one.FindTopDocuments("curly fancy cat"s);
+    const auto actual = batch.FindTopDocuments("curly fancy cat"s);
+    assert(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        assert(actual[i].id == expected[i].id);
+        assert(actual[i].relevance == expected[i].relevance);
+        assert(actual[i].rating == expected[i].rating);
+    }
+
+    //ошибочный документ: в исключении его id, пакет не добавлен
+    try {
+        batch.AddDocuments({{10, "big dog"s, DocumentStatus::ACTUAL, {1}}, {11, "bad\x12word"s, DocumentStatus::ACTUAL, {1}}});
+        assert(false);
+    } catch (const invalid_argument& e) {
+        assert(string(e.what()).find("11"s) != string::npos);
+    }
+    assert(batch.GetDocumentCount() == 3);
+
+    //документы проверяются по порядку: ошибка в тексте первого раньше повторного id второго
+    const vector<NewDocument> mixed = {{12, "bad\x12word"sv, DocumentStatus::ACTUAL, {1}}, {0, "big dog"sv, DocumentStatus::ACTUAL, {1}}};
+    for (const bool is_parallel : {false, true}) {
+        try {
+            is_parallel ? batch.AddDocuments(execution::par, mixed) : batch.AddDocuments(mixed);
+            assert(false);
+        } catch (const invalid_argument& e) {
+            assert(string(e.what()) == "Words in document not valid: document 12"s);
+        }
+    }
+    assert(batch.GetDocumentCount() == 3);
+    ConcurrentSearchServer concurrent("and in at"s);
+    concurrent.AddDocument(0, "curly cat"s, DocumentStatus::ACTUAL, {1});
+    try {
+        concurrent.AddDocuments(mixed);
+        assert(false);
+    } catch (const invalid_argument& e) {
+        assert(string(e.what()) == "Words in document not valid: document 12"s);
+    }
+}
+
+void TestSaveLoadIndex() {
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::BANNED, {1, 2, 3});
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+    search_server.AddDocument(4, "big dog sparrow Eugene"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    search_server.RemoveDocument(2);
+
+    const string path = "test_index.bin"s;
+    search_server.SaveIndex(path);
+    {
+        const SearchServer loaded = SearchServer::LoadIndex(path);
+        assert(loaded.GetDocumentCount() == 3);
+        const auto expected = search_server.FindTopDocuments("curly fancy cat dog"s);
+        const auto actual = loaded.FindTopDocuments("curly fancy cat dog"s);
+        assert(actual.size() == expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            assert(actual[i].id == expected[i].id);
+            assert(actual[i].relevance == expected[i].relevance);
+            assert(actual[i].rating == expected[i].rating);
+        }
+        assert(CollectWordFrequencies(loaded, 4) == CollectWordFrequencies(search_server, 4));
+        const auto [words, status] = loaded.MatchDocument("big cat -tail"s, 3);
+        assert(words.size() == 2);
+        assert(status == DocumentStatus::ACTUAL);
+
+        //сохранение поверх файла, из которого загружен сервер, не портит его данные
+        loaded.SaveIndex(path);
+        assert(loaded.FindTopDocuments("curly fancy cat dog"s).size() == expected.size());
+        assert(get<0>(loaded.MatchDocument("big cat -tail"s, 3)).size() == 2);
+        assert(SearchServer::LoadIndex(path).FindTopDocuments("curly fancy cat dog"s).size() == expected.size());
+    }
+
+    //повреждённые копии сохранённого файла
+    search_server.SaveIndex(path);
+    string data;
+    {
+        ifstream input(path, ios::binary);
+        data.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    const auto is_rejected = [&path](const string& corrupted) {
+        {
+            ofstream output(path, ios::binary);
+            output << corrupted;
+        }
+        try {
+            SearchServer::LoadIndex(path);
+        } catch (const runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    assert(!is_rejected(data));
+    //копия файла, в которой по смещению position записано число value
+    const auto patch = [&data](size_t position, auto value) {
+        string corrupted = data;
+        corrupted.replace(position, sizeof(value), reinterpret_cast<const char*>(&value), sizeof(value));
+        return corrupted;
+    };
+    const int32_t saved_ids[] = {1, 3, 4};
+    const size_t ids_position = data.find(string(reinterpret_cast<const char*>(saved_ids), sizeof(saved_ids)));
+    assert(ids_position != string::npos);
+    //число документов, на единицу меньшее переполнения
+    assert(is_rejected(patch(ids_position - sizeof(uint64_t), numeric_limits<uint64_t>::max())));
+    //повтор id и отрицательный id
+    assert(is_rejected(patch(ids_position + sizeof(int32_t), int32_t{1})));
+    assert(is_rejected(patch(ids_position, int32_t{-1})));
+
+    //Файл кончается прямым индексом (11 пар слово, число вхождений), началами списков документов
+    //(12 слов + 1) и списками (11 пар номер документа, число вхождений). Слова документа 1:
+    //curly (3), cat (4), tail (5); списки: curly {(0, 2)}, cat {(0, 1), (1, 1)}, ...
+    const size_t postings_position = data.size() - 11 * 2 * sizeof(uint32_t);
+    const size_t term_counts_position = postings_position - 13 * sizeof(uint64_t) - 11 * 2 * sizeof(uint32_t);
+    assert(!is_rejected(patch(term_counts_position, uint32_t{3})));
+    //стоп-слово в словах документа
+    assert(is_rejected(patch(term_counts_position, uint32_t{0})));
+    //номера в списке cat не возрастают
+    assert(is_rejected(patch(postings_position + 2 * 2 * sizeof(uint32_t), int32_t{0})));
+    //число вхождений curly в списке не совпадает с прямым индексом
+    assert(!is_rejected(patch(postings_position + sizeof(int32_t), uint32_t{2})));
+    assert(is_rejected(patch(postings_position + sizeof(int32_t), uint32_t{1})));
+    {
+        //словарь начинается не со стоп-слов сервера
+        string corrupted = data;
+        const size_t stop_words_position = corrupted.find("andatin"s);
+        const size_t dictionary_position = corrupted.find("andatin"s, stop_words_position + 1);
+        assert(dictionary_position != string::npos);
+        corrupted[dictionary_position + 6] = 'x';
+        assert(is_rejected(corrupted));
+    }
+    remove(path.c_str());
+
+    //файл не того формата
+    {
+        ofstream output(path, ios::binary);
+        output << "not an index"s;
+    }
+    try {
+        SearchServer::LoadIndex(path);
+        assert(false);
+    } catch (const runtime_error&) {
+    }
+    remove(path.c_str());
+}
+
+void TestConcurrentSearchServer() {
+    ConcurrentSearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    //до публикации запросы не видят изменений
+    assert(search_server.GetDocumentCount() == 0);
+    search_server.Publish();
+    assert(search_server.GetDocumentCount() == 1);
+
+    //запросы идут, пока документы добавляются и удаляются
+    atomic_bool stop = false;
+    vector<thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&search_server, &stop] {
+            int last_count = 0;
+            while (!stop) {
+                const auto snapshot = search_server.GetSnapshot();
+                const int count = snapshot->GetDocumentCount();
+                assert(count >= last_count);
+                assert(snapshot->FindTopDocuments("curly"s).size() == 1);
+                last_count = count;
+            }
+        });
+    }
+    for (int id = 2; id < 200; ++id) {
+        search_server.AddDocument(id, "big dog fancy collar "s + to_string(id), DocumentStatus::ACTUAL, {1, 2});
+        if (id % 10 == 0) {
+            search_server.Publish();
+        }
+    }
+    search_server.Publish();
+    stop = true;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    assert(search_server.GetDocumentCount() == 199);
+
+    //снимок, взятый до удаления, не меняется
+    const auto snapshot = search_server.GetSnapshot();
+    search_server.RemoveDocument(1);
+    search_server.AddDocuments({{300, "curly dog"s, DocumentStatus::ACTUAL, {1}}});
+    search_server.Publish();
+    assert(snapshot->FindTopDocuments("curly"s)[0].id == 1);
+    assert(search_server.FindTopDocuments("curly"s)[0].id == 300);
+    assert(search_server.GetDocumentCount() == 199);
+}
+
+void TestSegmentedIndex() {
+    //после публикаций, удалений и слияний результаты совпадают с обычным сервером
+    const vector<string> words = {"curly"s, "cat"s, "dog"s, "fancy"s, "collar"s, "tail"s, "big"s, "and"s};
+    SearchServer expected("and in at"s);
+    ConcurrentSearchServer actual("and in at"s);
+    for (int id = 0; id < 600; ++id) {
+        string text;
+        for (int i = 0; i < 1 + id % 5; ++i) {
+            text += words[(id * 7 + i * 3) % words.size()] + " "s;
+        }
+        expected.AddDocument(id, text, static_cast<DocumentStatus>(id % 3 == 0), {id % 10});
+        actual.AddDocument(id, text, static_cast<DocumentStatus>(id % 3 == 0), {id % 10});
+        if (id % 4 == 3) {
+            expected.RemoveDocument(id - 2);
+            actual.RemoveDocument(id - 2);
+        }
+        if (id % 20 == 19) {
+            actual.Publish();
+        }
+    }
+    actual.Publish();
+    actual.WaitForMerges();
+
+    const auto is_same_results = [&expected](const IndexSnapshot& snapshot) {
+        for (const string& query : {"curly dog"s, "fancy -tail"s, "big cat collar"s, "sparrow"s, "heron curly"s}) {
+            const auto expected_documents = expected.FindTopDocuments(query, DocumentStatus::ACTUAL, 50);
+            const auto actual_documents = snapshot.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 50);
+            assert(actual_documents.size() == expected_documents.size());
+            for (size_t i = 0; i < actual_documents.size(); ++i) {
+                assert(actual_documents[i].id == expected_documents[i].id);
+                assert(actual_documents[i].relevance == expected_documents[i].relevance);
+            }
+        }
+    };
+    const auto snapshot = actual.GetSnapshot();
+    assert(snapshot->GetSegmentCount() < 16);
+    assert(snapshot->GetDocumentCount() == expected.GetDocumentCount());
+    is_same_results(*snapshot);
+    const auto [matched_words, status] = snapshot->MatchDocument("curly cat dog"s, 4);
+    assert(matched_words == get<0>(expected.MatchDocument("curly cat dog"s, 4)));
+
+    //удаления из замороженных сегментов учитываются в idf сразу после публикации, до слияния
+    for (int id = 0; id < 600; id += 28) {
+        expected.RemoveDocument(id);
+        actual.RemoveDocument(id);
+    }
+    actual.Publish();
+    assert(actual.GetDocumentCount() == expected.GetDocumentCount());
+    is_same_results(*actual.GetSnapshot());
+
+    //слово, все документы с которым удалены, не даёт бесконечного веса
+    expected.AddDocument(1000, "heron"s, DocumentStatus::ACTUAL, {1});
+    expected.RemoveDocument(1000);
+    actual.AddDocument(1000, "heron"s, DocumentStatus::ACTUAL, {1});
+    actual.Publish();
+    actual.RemoveDocument(1000);
+    actual.Publish();
+    is_same_results(*actual.GetSnapshot());
+
+    //функция ранжирования и средняя длина документа переходят в снимок
+    const auto snapshot_before_ranking = actual.GetSnapshot();
+    expected.SetRanking(Bm25{1.5, 0.6});
+    actual.SetRanking(Bm25{1.5, 0.6});
+    actual.Publish();
+    is_same_results(*actual.GetSnapshot());
+    expected.SetRanking(TfIdf{});
+    is_same_results(*snapshot_before_ranking);
+    try {
+        actual.SetRanking(Bm25{1.2, 1.1});
+        assert(false);
+    } catch (const invalid_argument&) {
+    }
+
+    //удалённый id можно добавить снова
+    actual.RemoveDocument(4);
+    actual.AddDocument(4, "sparrow"s, DocumentStatus::ACTUAL, {1});
+    actual.Publish();
+    assert(actual.FindTopDocuments("sparrow"s).size() == 1);
+    assert(actual.GetDocumentCount() == expected.GetDocumentCount());
+}
+
+void TestProcessQueriesStream() {
+    SearchServer search_server("and with"s);
+    int id = 0;
+    for (const string& text : {"funny pet and nasty rat"s, "funny pet with curly hair"s, "funny pet and not very nasty rat"s,
+                               "pet with rat and rat and rat"s, "nasty rat with curly hair"s}) {
+        search_server.AddDocument(++id, text, DocumentStatus::ACTUAL, {1, 2});
+    }
+    const vector<string> queries = {"nasty rat -not"s, "not very funny nasty pet"s, "curly hair"s, "sparrow"s, "pet"s};
+    const auto expected = ProcessQueries(search_server, queries);
+
+    //окно меньше числа запросов, результаты приходят по порядку
+    size_t next_index = 0;
+    ProcessQueriesStream(search_server, queries.begin(), queries.end(), [&](size_t index, vector<Document>&& documents) {
+        assert(index == next_index++);
+        assert(documents.size() == expected[index].size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            assert(documents[i].id == expected[index][i].id);
+        }
+    }, 2);
+    assert(next_index == queries.size());
+
+    //запросы из генератора
+    size_t generated = 0;
+    size_t document_count = 0;
+    ProcessQueriesStream(search_server, [&generated, &queries]() -> optional<string> {
+        if (generated == queries.size()) {
+            return nullopt;
+        }
+        return queries[generated++];
+    }, [&document_count](size_t, vector<Document>&& documents) {
+        document_count += documents.size();
+    });
+    assert(document_count == ProcessQueriesJoined(search_server, queries).size());
+
+    //пустое окно
+    try {
+        ProcessQueriesStream(search_server, queries.begin(), queries.end(), [](size_t, vector<Document>&&) {
+            assert(false);
+        }, 0);
+        assert(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestQueryExecutor() {
+    const QueryExecutor executor(4, {0});
+    assert(executor.GetWorkerCount() == 4);
+
+    //вложенные вызовы из задач пула
+    atomic_int sum = 0;
+    executor.ParallelFor(10, [&executor, &sum](size_t i) {
+        executor.ParallelFor(i, [&sum](size_t j) {
+            sum += static_cast<int>(j);
+        });
+    });
+    assert(sum == 120);
+
+    SearchServer search_server("and in at"s);
+    for (int id = 0; id < 10'000; ++id) {
+        search_server.AddDocument(id, "cat dog word"s + to_string(id % 97) + " tail"s + to_string(id % 13), DocumentStatus::ACTUAL, {id % 7});
+    }
+    const vector<string> queries = {"cat word5"s, "tail3 -word7"s, "word1 word2 tail1"s, "sparrow"s};
+    const auto expected = ProcessQueries(search_server, queries);
+    const auto actual = ProcessQueries(executor, search_server, queries);
+    assert(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        assert(actual[i].size() == expected[i].size());
+        for (size_t j = 0; j < actual[i].size(); ++j) {
+            assert(actual[i][j].id == expected[i][j].id);
+        }
+    }
+    assert(ProcessQueriesJoined(executor, search_server, queries).size() == ProcessQueriesJoined(search_server, queries).size());
+
+    const auto documents = search_server.FindTopDocuments(executor, "word5 tail5"s, DocumentStatus::ACTUAL, 20);
+    const auto expected_documents = search_server.FindTopDocuments("word5 tail5"s, DocumentStatus::ACTUAL, 20);
+    assert(documents.size() == expected_documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        assert(documents[i].id == expected_documents[i].id);
+        assert(documents[i].relevance == expected_documents[i].relevance);
+    }
+
+    //исключение из задачи доходит до вызывающего
+    try {
+        ProcessQueries(executor, search_server, {"cat"s, "--dog"s});
+        assert(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestSplitIntoWords() {
+    //слова пересекают границы блоков по 16 и 32 байта, текст не кратен размеру блока
+    const string text = "  curly   cat"s + string(20, ' ') + string(40, 'x') + " \xD0\xBA\xD0\xBE\xD1\x82  tail "s + string(33, 'y');
+    const vector<string_view> words = SplitIntoWordsView(text);
+    const vector<string> expected = SplitIntoWords(text);
+    assert(words.size() == 6);
+    assert(equal(words.begin(), words.end(), expected.begin(), expected.end()));
+    assert(SplitIntoWordsView(""s).empty());
+    assert(SplitIntoWordsView(string(50, ' ')).empty());
+
+    const auto valid_words = SplitIntoValidWordsView(text);
+    assert(valid_words && *valid_words == words);
+    for (const size_t position : {0, 15, 16, 31, 40, 63}) {
+        string invalid_text = text;
+        invalid_text[position] = '\t';
+        assert(!SplitIntoValidWordsView(invalid_text));
+    }
+
+    SearchServer search_server("and in at"s);
+    try {
+        search_server.AddDocument(1, text + " \x01"s, DocumentStatus::ACTUAL, {1});
+        assert(false);
+    } catch (const invalid_argument&) {
+    }
+    try {
+        search_server.AddDocuments({{2, text, DocumentStatus::ACTUAL, {1}}, {3, "cat\x1F"s + text, DocumentStatus::ACTUAL, {1}}});
+        assert(false);
+    } catch (const invalid_argument& e) {
+        assert(e.what() == "Words in document not valid: document 3"s);
+    }
+    assert(search_server.GetDocumentCount() == 0);
+}
+
+void TestCompressPostings() {
+    //списки длиннее блока, в документах слова повторяются, поэтому частоты не только 1/длина
+    const auto fill = [](SearchServer& search_server, int first_id, int last_id) {
+        for (int id = first_id; id < last_id; ++id) {
+            string document;
+            for (int k = 0; k <= id % 7; ++k) {
+                document += " w"s + to_string((id * 13 + k * k * 7) % (3 + k * 5));
+            }
+            search_server.AddDocument(id, document, DocumentStatus::ACTUAL, {id % 4});
+        }
+    };
+    SearchServer plain("and in at"s);
+    SearchServer compressed("and in at"s);
+    fill(plain, 0, 1'000);
+    fill(compressed, 0, 1'000);
+    const size_t plain_memory_usage = compressed.GetPostingsMemoryUsage();
+    compressed.CompressPostings();
+    assert(compressed.GetPostingsMemoryUsage() < plain_memory_usage);
+
+    const vector<string> queries = {"w0"s, "w1 w3"s, "w0 w2 w17 w30 -w4"s, "w1 w5 w9 w11 w23 -w0 -w7"s, "w2 -w2"s};
+    const auto check = [&queries, &plain](const SearchServer& search_server) {
+        assert(search_server.GetDocumentCount() == plain.GetDocumentCount());
+        for (const string& query : queries) {
+            for (const size_t top_k : {1, 5, 50}) {
+                const auto expected = plain.FindTopDocuments(query, DocumentStatus::ACTUAL, top_k);
+                for (const auto& actual : {search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, top_k),
+                                           search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, top_k)}) {
+                    assert(actual.size() == expected.size());
+                    for (size_t i = 0; i < actual.size(); ++i) {
+                        assert(actual[i].id == expected[i].id);
+                        assert(actual[i].relevance == expected[i].relevance);
+                    }
+                }
+            }
+        }
+    };
+    check(compressed);
+
+    //новые документы копятся в несжатом хвосте, удаление больше половины сжимает списки заново
+    fill(plain, 1'000, 1'300);
+    fill(compressed, 1'000, 1'300);
+    check(compressed);
+    for (int id = 0; id < 1'300; id += 3) {
+        plain.RemoveDocument(id);
+        compressed.RemoveDocument(id);
+    }
+    check(compressed);
+    for (int id = 1; id < 1'300; id += 3) {
+        plain.RemoveDocument(id);
+        compressed.RemoveDocument(id);
+    }
+    check(compressed);
+    assert(CollectWordFrequencies(compressed, 5) == CollectWordFrequencies(plain, 5));
+
+    const string path = "test_index.bin"s;
+    compressed.SaveIndex(path);
+    check(SearchServer::LoadIndex(path));
+    remove(path.c_str());
+
+    //подряд идущие документы с одним вхождением слова упаковываются в 0 бит
+    SearchServer uniform("and in at"s);
+    for (int id = 0; id < 128; ++id) {
+        uniform.AddDocument(id, "cat"s, DocumentStatus::ACTUAL, {1});
+    }
+    uniform.CompressPostings();
+    const auto documents = uniform.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 200);
+    assert(documents.size() == 128);
+    assert(get<0>(uniform.MatchDocument("cat"s, 127)).size() == 1);
+}
+
+void TestTermCounts() {
+    //tf выводится из числа вхождений и длины документа без стоп-слов при каждом обращении
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "cat and cat dog in cat"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, {2});
+    search_server.AddDocuments({{3, "cat bird bird and"s, DocumentStatus::ACTUAL, {3}}});
+    const map<string_view, double> expected = {{"cat"sv, 3.0 / 4}, {"dog"sv, 1.0 / 4}};
+    assert(CollectWordFrequencies(search_server, 1) == expected);
+    assert(search_server.GetWordFrequencies(3).at("bird"sv) == 2.0 / 3);
+
+    const auto documents = search_server.FindTopDocuments("cat bird"s);
+    assert(documents.size() == 2);
+    assert(documents[0].id == 3);
+    assert(documents[0].relevance == (1.0 / 3 + 1.0 / 3) * log(3.0) + 1.0 / 3 * log(3.0 / 2));
+
+    const string path = "test_index.bin"s;
+    search_server.SaveIndex(path);
+    const SearchServer loaded = SearchServer::LoadIndex(path);
+    remove(path.c_str());
+    search_server.CompressPostings();
+    for (const SearchServer* server : {&loaded, static_cast<const SearchServer*>(&search_server)}) {
+        assert(CollectWordFrequencies(*server, 1) == expected);
+        const auto actual = server->FindTopDocuments("cat bird"s);
+        assert(actual.size() == documents.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            assert(actual[i].id == documents[i].id);
+            assert(actual[i].relevance == documents[i].relevance);
+        }
+    }
+}
+
+void TestBm25Ranking() {
+    //слова в документах повторяются, длины документов разные
+    SearchServer search_server("and in at"s);
+    vector<string> texts;
+    for (int id = 0; id < 2'000; ++id) {
+        string document;
+        for (int k = 0; k <= id % 11; ++k) {
+            document += " w"s + to_string((id * 7 + k * k * 13) % (4 + k * 3));
+        }
+        texts.push_back(document);
+        search_server.AddDocument(id, document, DocumentStatus::ACTUAL, {id % 3});
+    }
+    for (int id = 0; id < 2'000; id += 5) {
+        search_server.RemoveDocument(id);
+    }
+    const auto tf_idf_documents = search_server.FindTopDocuments("w1 w3 -w5"s);
+
+    const double k1 = 1.5;
+    const double b = 0.6;
+    search_server.SetRanking(Bm25{k1, b});
+    map<int, map<string, uint32_t>> word_counts;
+    map<string, int> word_document_counts;
+    uint64_t total_length = 0;
+    for (const int id : search_server) {
+        for (const string& word : SplitIntoWords(texts[id])) {
+            if (word_counts[id][word]++ == 0) {
+                ++word_document_counts[word];
+            }
+            ++total_length;
+        }
+    }
+    const int document_count = search_server.GetDocumentCount();
+    const double average_length = total_length * 1.0 / document_count;
+    assert(search_server.GetCollectionStats().average_document_length == average_length);
+
+    const auto find_expected = [&](const set<string>& plus_words, const set<string>& minus_words, size_t top_k) {
+        vector<Document> documents;
+        for (const auto& [id, counts] : word_counts) {
+            const bool has_minus_word = any_of(minus_words.begin(), minus_words.end(), [&counts = counts](const string& word) {
+                return counts.count(word) > 0;
+            });
+            if (has_minus_word) {
+                continue;
+            }
+            uint32_t length = 0;
+            for (const auto& [_, count] : counts) {
+                length += count;
+            }
+            double relevance = 0.0;
+            bool is_matched = false;
+            for (const string& word : plus_words) {
+                const auto it = counts.find(word);
+                if (it != counts.end()) {
+                    const int n = word_document_counts.at(word);
+                    const double idf = log(1.0 + (document_count - n + 0.5) / (n + 0.5));
+                    const double length_norm = 1.0 - b + b * length / average_length;
+                    relevance += idf * it->second * (k1 + 1.0) / (it->second + k1 * length_norm);
+                    is_matched = true;
+                }
+            }
+            if (is_matched) {
+                documents.push_back({id, relevance, id % 3});
+            }
+        }
+        sort(documents.begin(), documents.end(), [](const Document& lhs, const Document& rhs) {
+            if (abs(lhs.relevance - rhs.relevance) < EPSILON()) {
+                return lhs.rating == rhs.rating ? lhs.id < rhs.id : lhs.rating > rhs.rating;
+            }
+            return lhs.relevance > rhs.relevance;
+        });
+        documents.resize(min(documents.size(), top_k));
+        return documents;
+    };
+
+    const vector<pair<set<string>, set<string>>> queries = {
+        {{"w0"s}, {}}, {{"w1"s, "w3"s}, {"w5"s}}, {{"w2"s, "w6"s, "w13"s, "w20"s}, {}}, {{"w1"s, "w4"s, "w9"s, "w30"s}, {"w0"s}}};
+    for (const auto& [plus_words, minus_words] : queries) {
+        string query;
+        for (const string& word : plus_words) {
+            query += word + " "s;
+        }
+        for (const string& word : minus_words) {
+            query += "-"s + word + " "s;
+        }
+        for (const size_t top_k : {1, 5, 50}) {
+            const auto expected = find_expected(plus_words, minus_words, top_k);
+            for (const auto& actual : {search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, top_k),
+                                       search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, top_k)}) {
+                assert(actual.size() == expected.size());
+                for (size_t i = 0; i < actual.size(); ++i) {
+                    assert(actual[i].id == expected[i].id);
+                    assert(actual[i].relevance == expected[i].relevance);
+                }
+            }
+        }
+    }
+
+    search_server.SetRanking(TfIdf{});
+    const auto documents = search_server.FindTopDocuments("w1 w3 -w5"s);
+    assert(documents.size() == tf_idf_documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        assert(documents[i].id == tf_idf_documents[i].id);
+        assert(documents[i].relevance == tf_idf_documents[i].relevance);
+    }
+
+    //при недопустимых параметрах оценка сверху неверна, функция не меняется
+    for (const Bm25& bm25 : {Bm25{-0.1, 0.75}, Bm25{1.2, -0.1}, Bm25{1.2, 1.1}, Bm25{nan(""), 0.75}}) {
+        try {
+            search_server.SetRanking(bm25);
+            assert(false);
+        } catch (const invalid_argument&) {
+        }
+    }
+    assert(search_server.FindTopDocuments("w1 w3 -w5"s)[0].relevance == tf_idf_documents[0].relevance);
+    search_server.SetRanking(Bm25{0.0, 0.0});
+    search_server.SetRanking(Bm25{0.0, 1.0});
+}
+
+void TestQueryResultCache() {
+    const auto is_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        });
+    };
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::BANNED, {1, 2, 3});
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+
+    //порядок, повторы и неизвестные слова ключ не меняют
+    QueryResultCache cache(search_server, 1 << 20);
+    assert(is_same(cache.FindTopDocuments("curly cat -dog"s), search_server.FindTopDocuments("curly cat -dog"s)));
+    assert(is_same(cache.FindTopDocuments("cat curly -dog cat parrot"s), search_server.FindTopDocuments("curly cat -dog"s)));
+    assert(is_same(cache.FindTopDocuments(execution::par, "curly cat -dog"s),
+                   search_server.FindTopDocuments("curly cat -dog"s)));
+    assert(cache.GetStats().hits == 2 && cache.GetStats().misses == 1);
+    assert(is_same(cache.FindTopDocuments("curly cat -dog"s, DocumentStatus::BANNED),
+                   search_server.FindTopDocuments("curly cat -dog"s, DocumentStatus::BANNED)));
+    assert(is_same(cache.FindTopDocuments("curly cat"s, DocumentStatus::BANNED),
+                   search_server.FindTopDocuments("curly cat"s, DocumentStatus::BANNED)));
+    assert(cache.GetStats().misses == 3 && cache.GetStats().entry_count == 3);
+
+    //изменение индекса делает прежние результаты устаревшими
+    search_server.AddDocument(4, "curly cat"s, DocumentStatus::ACTUAL, {9});
+    const auto documents = cache.FindTopDocuments("curly cat -dog"s);
+    assert(documents.size() == 3 && documents[0].id == 4);
+    assert(is_same(documents, search_server.FindTopDocuments("curly cat -dog"s)));
+    search_server.RemoveDocument(4);
+    assert(is_same(cache.FindTopDocuments("curly cat -dog"s), search_server.FindTopDocuments("curly cat -dog"s)));
+    assert(cache.GetStats().hits == 2 && cache.GetStats().misses == 5);
+
+    //кеш не занимает больше отведённой памяти, давние результаты вытесняются
+    const vector<string> words = {"curly"s, "cat"s, "tail"s, "dog"s, "fancy"s, "collar"s, "big"s};
+    QueryResultCache small_cache(search_server, 2'000, 2);
+    for (const string& lhs : words) {
+        for (const string& rhs : words) {
+            small_cache.FindTopDocuments(lhs + " -"s + rhs);
+        }
+    }
+    const QueryCacheStats stats = small_cache.GetStats();
+    assert(stats.evictions > 0 && stats.memory_usage <= 2'000);
+    assert(stats.evictions + stats.entry_count == stats.misses);
+    small_cache.Clear();
+    assert(small_cache.GetStats().entry_count == 0 && small_cache.GetStats().memory_usage == 0);
+
+    //одновременные запросы из нескольких потоков
+    vector<string> queries;
+    for (int i = 0; i < 1'000; ++i) {
+        queries.push_back(words[i % words.size()] + " "s + words[i * 3 % words.size()]);
+    }
+    QueryResultCache shared_cache(search_server, 1 << 20);
+    for_each(execution::par, queries.begin(), queries.end(), [&](const string& query) {
+        assert(is_same(shared_cache.FindTopDocuments(query), search_server.FindTopDocuments(query)));
+    });
+    assert(shared_cache.GetStats().hits + shared_cache.GetStats().misses == queries.size());
+}
+
+void TestQueryContext() {
+    const auto is_same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        });
+    };
+    SearchServer search_server("and in at"s);
+    search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::BANNED, {1, 2, 3});
+    search_server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+    search_server.AddDocument(4, "big dog sparrow eugene"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    for (int id = 5; id < 200; ++id) {
+        search_server.AddDocument(id, "fancy dog number "s + to_string(id % 17), DocumentStatus::ACTUAL, {id});
+    }
+    search_server.CompressPostings();
+    search_server.AddDocument(200, "curly fancy dog"s, DocumentStatus::ACTUAL, {5});
+
+    const vector<string> queries = {"curly cat -dog"s, "fancy dog -collar"s, "big cat tail parrot"s, "-curly dog"s};
+    SearchServer::QueryContext context;
+    //результаты совпадают с поиском без контекста
+    for (const string& query : queries) {
+        assert(is_same(search_server.FindTopDocuments(context, query), search_server.FindTopDocuments(query)));
+        assert(is_same(search_server.FindTopDocuments(context, query, DocumentStatus::BANNED, 2),
+                       search_server.FindTopDocuments(query, DocumentStatus::BANNED, 2)));
+        for (int id : {1, 2, 3, 200}) {
+            const auto [words, status] = search_server.MatchDocument(context, query, id);
+            const auto [expected_words, expected_status] = search_server.MatchDocument(query, id);
+            assert(words == expected_words && status == expected_status);
+        }
+    }
+
+    //счётчик видит выделения поиска без контекста
+    const size_t uncached_allocation_count = GetAllocationCount();
+    search_server.FindTopDocuments(queries[0]);
+    assert(GetAllocationCount() > uncached_allocation_count);
+
+    //после прогрева буферы контекста переиспользуются, запросы не выделяют память
+    const size_t allocation_count = GetAllocationCount();
+    for (int i = 0; i < 100; ++i) {
+        for (const string& query : queries) {
+            search_server.FindTopDocuments(context, query);
+            search_server.FindTopDocuments(context, query, [](int document_id, DocumentStatus, int) {
+                return document_id % 2 == 0;
+            });
+            search_server.MatchDocument(context, query, 1 + i % 4);
+        }
+    }
+    assert(GetAllocationCount() == allocation_count);
+}
+
+void TestGallopingSearch() {
+    vector<int> values;
+    for (int i = 0; i < 300; ++i) {
+        values.push_back(i * 7 / 3);
+    }
+    for (size_t first = 0; first <= values.size(); first += 13) {
+        for (int value = -1; value <= values.back() + 1; ++value) {
+            assert(GallopingLowerBound(values.begin() + first, values.end(), value)
+                   == lower_bound(values.begin() + first, values.end(), value));
+        }
+    }
+
+    //частые минус-слова проверяются по спискам галопом: результат тот же, что полным перебором
+    SearchServer search_server("and in at"s);
+    const vector<string> words = {"the"s, "cat"s, "dog"s, "curly"s, "tail"s, "collar"s, "big"s};
+    for (int id = 0; id < 1'000; ++id) {
+        string text = id % 10 == 8 ? "little"s : "the"s;
+        for (int i = 1; i < static_cast<int>(words.size()); ++i) {
+            if (id % (i + 1) == 0) {
+                text += " "s + words[i];
+            }
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {id % 5});
+        if (id == 600) {
+            search_server.CompressPostings();
+        }
+    }
+    SearchServer::QueryContext context;
+    for (const string& query : {"cat -the"s, "cat dog -the -big"s, "curly tail -collar -the"s, "big -cat"s, "-the"s}) {
+        const auto documents = search_server.FindTopDocuments(query, [](int, DocumentStatus, int) {
+            return true;
+        }, 1'000);
+        size_t expected_count = 0;
+        for (int id = 0; id < 1'000; ++id) {
+            const auto [matched_words, status] = search_server.MatchDocument(query, id);
+            assert(matched_words == get<0>(search_server.MatchDocument(execution::par, query, id)));
+            assert(matched_words == get<0>(search_server.MatchDocument(context, query, id)));
+            expected_count += matched_words.empty() ? 0 : 1;
+        }
+        assert(documents.size() == expected_count);
+        for (const Document& document : documents) {
+            assert(!get<0>(search_server.MatchDocument(query, document.id)).empty());
+        }
+    }
+    assert(search_server.FindTopDocuments("cat -the"s).size() == 5);
+}
+
+void TestDuplicateDetector() {
+    const auto is_same = [](const vector<DuplicateDocument>& lhs, const vector<DuplicateDocument>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const DuplicateDocument& lhs, const DuplicateDocument& rhs) {
+            return lhs.document_id == rhs.document_id && lhs.original_id == rhs.original_id && lhs.similarity == rhs.similarity;
+        });
+    };
+    {
+        SearchServer search_server("and with"s);
+        search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(8, "and with"s, DocumentStatus::ACTUAL, {1, 2});
+        search_server.AddDocument(9, "with"s, DocumentStatus::ACTUAL, {1, 2});
+        const vector<DuplicateDocument> expected = {{3, 2, 1.0}, {4, 2, 1.0}, {5, 1, 1.0}, {7, 6, 1.0}, {9, 8, 1.0}};
+        const DuplicateDetector detector(search_server);
+        assert(is_same(detector.FindExactDuplicates(), expected));
+        assert(is_same(detector.FindExactDuplicates(execution::par), expected));
+        //{funny, pet, nasty, rat} и {funny, pet, not, very, nasty, rat}: 4 / 6
+        const auto near_duplicates = detector.FindNearDuplicates({0.6, 50, 2});
+        assert(near_duplicates.size() == 6 && near_duplicates[3].document_id == 6 && near_duplicates[3].original_id == 1);
+        assert(near_duplicates[3].similarity == 4.0 / 6 && near_duplicates[4].original_id == 1);
+        try {
+            detector.FindNearDuplicates({1.5});
+            assert(false);
+        } catch (const invalid_argument&) {
+        }
+    }
+
+    //исходные документы из 10 слов, их копии с одним (мера 9 / 11) и с четырьмя (6 / 14) заменёнными словами
+    mt19937 generator;
+    SearchServer search_server(""s);
+    vector<vector<string>> texts;
+    for (int id = 0; id < 2'000; ++id) {
+        vector<string> words;
+        if (id % 4 == 0 || texts.empty()) {
+            for (int i = 0; i < 10; ++i) {
+                words.push_back("w"s + to_string(uniform_int_distribution(0, 50'000)(generator)));
+            }
+        } else {
+            words = texts[id / 4 * 4];
+            const int replaced_count = id % 4 == 1 ? 0 : id % 4 == 2 ? 1 : 4;
+            for (int i = 0; i < replaced_count; ++i) {
+                words[i] = "r"s + to_string(id) + "_"s + to_string(i);
+            }
+        }
+        texts.push_back(words);
+        string text;
+        for (const string& word : words) {
+            text += word + " "s;
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    }
+    const DuplicateDetector detector(search_server);
+    const auto duplicates = detector.FindNearDuplicates();
+    assert(is_same(duplicates, detector.FindNearDuplicates(execution::par)));
+    vector<DuplicateDocument> expected;
+    for (int id = 0; id < 2'000; ++id) {
+        if (id % 4 == 1) {
+            expected.push_back({id, id / 4 * 4, 1.0});
+        } else if (id % 4 == 2) {
+            expected.push_back({id, id / 4 * 4, 9.0 / 11});
+        }
+    }
+    assert(is_same(duplicates, expected));
+    //порог ниже 6 / 14 находит и дальние копии
+    const auto far_duplicates = detector.FindNearDuplicates({0.4, 60, 2});
+    assert(far_duplicates.size() == 1'500);
+    assert(is_same(detector.FindExactDuplicates(), detector.FindNearDuplicates({1.0})));
+
+    //все документы различаются одним словом и попадают в одни корзины: каждый сверяется только
+    //с первыми документами корзины, а не со всеми, и остаётся дубликатом первого документа
+    SearchServer similar_server(""s);
+    string common_text;
+    for (int i = 0; i < 30; ++i) {
+        common_text += "c"s + to_string(i) + " "s;
+    }
+    for (int id = 0; id < 3'000; ++id) {
+        similar_server.AddDocument(id, common_text + "u"s + to_string(id), DocumentStatus::ACTUAL, {1});
+    }
+    const auto similar_duplicates = DuplicateDetector(similar_server).FindNearDuplicates({0.9, 32, 4, 0, 4});
+    assert(similar_duplicates.size() == 2'999);
+    for (const DuplicateDocument& duplicate : similar_duplicates) {
+        assert(duplicate.original_id == 0 && duplicate.similarity == 30.0 / 32);
+    }
+    try {
+        detector.FindNearDuplicates({0.8, 32, 4, 0, 0});
+        assert(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
 void TestSearchServer() {
     BeginEndSizeTest();
     TestGetWordFrequencies();
     TestRemoveDocument();
+    TestRemoveDocumentCompaction();
+    TestRemoveDocuments();
     TestRemoveDuplicates();
+    TestFindTopDocumentsTopK();
+    TestFindTopDocumentsShards();
+    TestFindTopDocumentsPruning();
+    TestAddDocumentWithStorage();
+    TestAddDocuments();
+    TestSaveLoadIndex();
+    TestConcurrentSearchServer();
+    TestSegmentedIndex();
+    TestProcessQueriesStream();
+    TestQueryExecutor();
+    TestSplitIntoWords();
+    TestCompressPostings();
+    TestTermCounts();
+    TestBm25Ranking();
+    TestQueryResultCache();
+    TestQueryContext();
+    TestGallopingSearch();
+    TestDuplicateDetector();
 
     cout << "TestSearchServer is ok"s << endl;
 }
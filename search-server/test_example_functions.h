@@ -1,22 +1,39 @@
 #pragma once
 
+#include "test_allocation_counter.h"
 #include "read_input_functions.h"
 #include "document.h"
 #include "search_server.h"
+#include "concurrent_search_server.h"
+#include "process_queries.h"
+#include "query_executor.h"
+#include "query_result_cache.h"
 #include "log_duration.h"
 #include "remove_duplicates.h"
 
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <execution>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <thread>
 
 void AddDocument(SearchServer &search_server, int document_id, const std::string &document, DocumentStatus status,
                  const std::vector<int> &ratings);
 
 void FindTopDocuments(const SearchServer &search_server, const std::string &raw_query);
 
+std::map<std::string_view, double> CollectWordFrequencies(const SearchServer &search_server, int document_id);
+
 void BeginEndSizeTest();
 
 void TestGetWordFrequencies();
@@ -25,8 +42,48 @@ void RemoveDocument(SearchServer &search_server, int document_id);
 
 void TestRemoveDocument();
 
+void TestRemoveDocumentCompaction();
+
+void TestRemoveDocuments();
+
 void TestRemoveDuplicates();
 
+void TestFindTopDocumentsTopK();
+
+void TestFindTopDocumentsShards();
+
+void TestFindTopDocumentsPruning();
+
+void TestAddDocumentWithStorage();
+
+void TestAddDocuments();
+
+void TestSaveLoadIndex();
+
+void TestConcurrentSearchServer();
+
+void TestSegmentedIndex();
+
+void TestProcessQueriesStream();
+
+void TestQueryExecutor();
+
+void TestSplitIntoWords();
+
+void TestCompressPostings();
+
+void TestTermCounts();
+
+void TestBm25Ranking();
+
+void TestQueryResultCache();
+
+void TestQueryContext();
+
+void TestGallopingSearch();
+
+void TestDuplicateDetector();
+
 void TestSearchServer();
 
 
@@ -0,0 +1,86 @@
+#include "text_arena.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TextArena::TextArena(size_t chunk_size) : chunk_size_(chunk_size) {
+}
+
+TextArena::TextArena(const TextArena& other)
+    : chunk_size_(other.chunk_size_)
+    , chunks_(other.chunks_)
+    , chunk_ranges_(other.chunk_ranges_)
+    , memory_usage_(other.memory_usage_)
+    , external_storages_(other.external_storages_) {
+}
+
+TextArena& TextArena::operator=(const TextArena& other) {
+    if (this != &other) {
+        chunk_size_ = other.chunk_size_;
+        chunks_ = other.chunks_;
+        chunk_ranges_ = other.chunk_ranges_;
+        chunk_used_ = 0;
+        chunk_capacity_ = 0;
+        memory_usage_ = other.memory_usage_;
+        external_storages_ = other.external_storages_;
+    }
+    return *this;
+}
+
+string_view TextArena::Store(string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+
+    //длинный текст получает отдельный блок, текущий блок продолжает заполняться
+    if (text.size() > chunk_size_ / 4) {
+        shared_ptr<char[]> chunk(new char[text.size()]);
+        copy(text.begin(), text.end(), chunk.get());
+        chunks_.insert(chunk_capacity_ > 0 ? prev(chunks_.end()) : chunks_.end(), chunk);
+        chunk_ranges_.emplace(chunk.get(), chunk.get() + text.size());
+        memory_usage_ += text.size();
+        return {chunk.get(), text.size()};
+    }
+
+    if (chunk_capacity_ - chunk_used_ < text.size()) {
+        chunks_.emplace_back(new char[chunk_size_]);
+        chunk_ranges_.emplace(chunks_.back().get(), chunks_.back().get() + chunk_size_);
+        chunk_used_ = 0;
+        chunk_capacity_ = chunk_size_;
+        memory_usage_ += chunk_size_;
+    }
+    char* data = chunks_.back().get() + chunk_used_;
+    copy(text.begin(), text.end(), data);
+    chunk_used_ += text.size();
+    return {data, text.size()};
+}
+
+string_view TextArena::Adopt(string_view text, shared_ptr<const void> storage) {
+    //документы одного буфера обычно добавляются подряд, храним владельца один раз
+    if (external_storages_.empty() || external_storages_.back() != storage) {
+        external_storages_.push_back(move(storage));
+    }
+    return text;
+}
+
+size_t TextArena::GetMemoryUsage() const {
+    return memory_usage_;
+}
+
+TextArena TextArena::CopyExternalStorages() const {
+    TextArena result(chunk_size_);
+    result.external_storages_ = external_storages_;
+    return result;
+}
+
+string_view TextArena::Relocate(string_view text, TextArena& target) const {
+    if (text.empty()) {
+        return {};
+    }
+    const auto it = chunk_ranges_.upper_bound(text.data());
+    if (it == chunk_ranges_.begin() || text.data() >= prev(it)->second) {
+        return text;
+    }
+    return target.Store(text);
+}
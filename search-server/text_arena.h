@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+//Хранилище текста, в которое можно только дописывать. Текст лежит в блоках фиксированного
+//размера, блоки не перемещаются, поэтому выданные string_view действительны, пока жив TextArena
+class TextArena {
+public:
+    explicit TextArena(std::size_t chunk_size = default_chunk_size_);
+
+    //копия разделяет с исходным хранилищем уже записанные блоки, а дописывает в свои
+    TextArena(const TextArena& other);
+    TextArena& operator=(const TextArena& other);
+    TextArena(TextArena&&) = default;
+    TextArena& operator=(TextArena&&) = default;
+
+    //копирует текст в хранилище
+    std::string_view Store(std::string_view text);
+
+    //текст остаётся во внешнем буфере (например, в отображённом в память файле), хранилище
+    //только продлевает жизнь буфера через storage
+    std::string_view Adopt(std::string_view text, std::shared_ptr<const void> storage);
+
+    //размер блоков хранилища, включая общие с копиями; внешние буферы не учитываются
+    std::size_t GetMemoryUsage() const;
+
+    //Уплотнение: пустое хранилище с теми же внешними буферами, в которое Relocate переносит
+    //живой текст. Старые блоки освобождаются вместе со старым хранилищем
+    TextArena CopyExternalStorages() const;
+
+    //текст из блоков этого хранилища копирует в target, текст внешних буферов возвращает как есть
+    std::string_view Relocate(std::string_view text, TextArena& target) const;
+
+private:
+    const static std::size_t default_chunk_size_ = 1 << 20;
+
+    std::size_t chunk_size_;
+    std::vector<std::shared_ptr<char[]>> chunks_;
+    //начало блока -> его конец, чтобы отличать свой текст от внешнего
+    std::map<const char*, const char*> chunk_ranges_;
+    std::size_t chunk_used_ = 0;
+    std::size_t chunk_capacity_ = 0;
+    std::size_t memory_usage_ = 0;
+    std::vector<std::shared_ptr<const void>> external_storages_;
+};